@@ -0,0 +1,181 @@
+//
+//  autodiff.cpp
+//  OptionsPricing
+//
+
+// algorithmic differentiation library: forward-mode dual numbers and a reverse-mode tape
+#ifndef AUTODIFF
+#define AUTODIFF
+#include "util.cpp"
+
+using namespace std;
+
+inline double primal(double x){return x;} // value of a scalar with its derivative part dropped
+
+/**** forward mode ****/
+
+template <int N>
+class dual{
+    // value with its derivatives in N directions, all carried forward through each operation:
+    // one pass gives the gradient in N inputs for about N+1 times the cost of a double evaluation
+public:
+    double v, d[N]; // value: v, derivatives: d
+    /**** constructors ****/
+    dual():v(0){fill(d,d+N,0.);}
+    dual(double v):v(v){fill(d,d+N,0.);} // constant
+    dual(double v, int k):v(v){fill(d,d+N,0.); d[k] = 1;} // k-th independent variable
+    /**** accessors ****/
+    double getValue() const {return v;}
+    double getDeriv(int k) const {return d[k];}
+    dual chain(double fv, double df) const { // f(this) given f and f' at v
+        dual y(fv);
+        for(int k=0; k<N; k++) y.d[k] = df*d[k];
+        return y;
+    }
+    /**** operators ****/
+    friend dual operator+(const dual& x, const dual& y){dual z(x.v+y.v); for(int k=0; k<N; k++) z.d[k] = x.d[k]+y.d[k]; return z;}
+    friend dual operator+(const dual& x, double a){dual z(x); z.v += a; return z;}
+    friend dual operator+(double a, const dual& x){return x+a;}
+    friend dual operator-(const dual& x, const dual& y){dual z(x.v-y.v); for(int k=0; k<N; k++) z.d[k] = x.d[k]-y.d[k]; return z;}
+    friend dual operator-(const dual& x, double a){dual z(x); z.v -= a; return z;}
+    friend dual operator-(double a, const dual& x){return x.chain(a-x.v,-1);}
+    friend dual operator-(const dual& x){return x.chain(-x.v,-1);}
+    friend dual operator*(const dual& x, const dual& y){dual z(x.v*y.v); for(int k=0; k<N; k++) z.d[k] = x.d[k]*y.v+x.v*y.d[k]; return z;}
+    friend dual operator*(const dual& x, double a){return x.chain(x.v*a,a);}
+    friend dual operator*(double a, const dual& x){return x.chain(a*x.v,a);}
+    friend dual operator/(const dual& x, const dual& y){
+        dual z(x.v/y.v);
+        for(int k=0; k<N; k++) z.d[k] = (x.d[k]-z.v*y.d[k])/y.v;
+        return z;
+    }
+    friend dual operator/(const dual& x, double a){return x.chain(x.v/a,1/a);}
+    friend dual operator/(double a, const dual& x){double z = a/x.v; return x.chain(z,-z/x.v);}
+    friend dual& operator+=(dual& x, const dual& y){return x = x+y;}
+    friend dual& operator-=(dual& x, const dual& y){return x = x-y;}
+    friend dual& operator*=(dual& x, const dual& y){return x = x*y;}
+    friend dual& operator/=(dual& x, const dual& y){return x = x/y;}
+    friend bool operator<(const dual& x, const dual& y){return x.v<y.v;}
+    friend bool operator>(const dual& x, const dual& y){return x.v>y.v;}
+    friend bool operator<=(const dual& x, const dual& y){return x.v<=y.v;}
+    friend bool operator>=(const dual& x, const dual& y){return x.v>=y.v;}
+    friend dual max(const dual& x, const dual& y){ // ties take the mean of both one-sided derivatives
+        if(x.v!=y.v) return (x.v<y.v)?y:x;
+        dual z(x.v);
+        for(int k=0; k<N; k++) z.d[k] = (x.d[k]+y.d[k])/2;
+        return z;
+    }
+    friend ostream& operator<<(ostream& out, const dual& x){
+        out << x.v << " [";
+        for(int k=0; k<N; k++) out << x.d[k] << ((k==N-1)?"]":",");
+        return out;
+    }
+};
+
+template <int N> double primal(const dual<N>& x){return x.v;}
+template <int N> dual<N> exp(const dual<N>& x){double e = exp(x.v); return x.chain(e,e);}
+template <int N> dual<N> log(const dual<N>& x){return x.chain(log(x.v),1/x.v);}
+template <int N> dual<N> sqrt(const dual<N>& x){double s = sqrt(x.v); return x.chain(s,.5/s);}
+template <int N> dual<N> pow(const dual<N>& x, double a){double p = pow(x.v,a); return x.chain(p,a*p/x.v);}
+template <int N> dual<N> fabs(const dual<N>& x){return x.chain(fabs(x.v),(x.v>0)-(x.v<0));}
+template <int N> dual<N> normalCDF(const dual<N>& x){return x.chain(normalCDF(x.v),normalPDF(x.v));}
+template <int N> dual<N> normalPDF(const dual<N>& x){double p = normalPDF(x.v); return x.chain(p,-x.v*p);}
+
+/**** reverse mode ****/
+
+class ADTape{
+    // Wengert list of the operations on adouble: each node keeps its (at most two) arguments with the
+    // partial derivatives in them, so that one reverse sweep from an output gives its adjoint in every
+    // node recorded before it; one tape per thread
+public:
+    struct Node{int arg0, arg1; double partial0, partial1;};
+    vector<Node> nodes;
+    /**** accessors ****/
+    int size() const {return (int)nodes.size();}
+    static ADTape& active(){static thread_local ADTape tape; return tape;}
+    /**** mutators ****/
+    int record(int arg0, double partial0, int arg1=-1, double partial1=0){
+        nodes.push_back({arg0,arg1,partial0,partial1});
+        return (int)nodes.size()-1;
+    }
+    void clear(){nodes.clear();}
+    /**** main ****/
+    vector<double> adjoint(int output) const;
+};
+
+vector<double> ADTape::adjoint(int output) const {
+    // d(output)/d(node) for every node, nodes are recorded after their arguments
+    vector<double> adj(output+1,0.);
+    if(output<0) return adj;
+    adj[output] = 1;
+    for(int k=output; k>=0; k--){
+        double a = adj[k];
+        if(a==0) continue;
+        const Node& node = nodes[k];
+        if(node.arg0>=0) adj[node.arg0] += node.partial0*a;
+        if(node.arg1>=0) adj[node.arg1] += node.partial1*a;
+    }
+    return adj;
+}
+
+class adouble{
+    // double recorded on the active tape, constants (k=-1) are not recorded
+public:
+    double v; int k; // value: v, node on the tape: k
+    /**** constructors ****/
+    adouble():v(0),k(-1){}
+    adouble(double v):v(v),k(-1){} // constant
+    static adouble variable(double v){adouble x(v); x.k = ADTape::active().record(-1,0); return x;} // independent
+    /**** accessors ****/
+    double getValue() const {return v;}
+    int getNode() const {return k;}
+    adouble chain(double fv, double df) const { // f(this) given f and f' at v
+        adouble y(fv);
+        if(k>=0) y.k = ADTape::active().record(k,df);
+        return y;
+    }
+    static adouble chain(const adouble& x, const adouble& y, double fv, double dfx, double dfy){
+        adouble z(fv);
+        if(x.k>=0 && y.k>=0) z.k = ADTape::active().record(x.k,dfx,y.k,dfy);
+        else if(x.k>=0) z.k = ADTape::active().record(x.k,dfx);
+        else if(y.k>=0) z.k = ADTape::active().record(y.k,dfy);
+        return z;
+    }
+    /**** operators ****/
+    friend adouble operator+(const adouble& x, const adouble& y){return chain(x,y,x.v+y.v,1,1);}
+    friend adouble operator+(const adouble& x, double a){return x.chain(x.v+a,1);}
+    friend adouble operator+(double a, const adouble& x){return x.chain(a+x.v,1);}
+    friend adouble operator-(const adouble& x, const adouble& y){return chain(x,y,x.v-y.v,1,-1);}
+    friend adouble operator-(const adouble& x, double a){return x.chain(x.v-a,1);}
+    friend adouble operator-(double a, const adouble& x){return x.chain(a-x.v,-1);}
+    friend adouble operator-(const adouble& x){return x.chain(-x.v,-1);}
+    friend adouble operator*(const adouble& x, const adouble& y){return chain(x,y,x.v*y.v,y.v,x.v);}
+    friend adouble operator*(const adouble& x, double a){return x.chain(x.v*a,a);}
+    friend adouble operator*(double a, const adouble& x){return x.chain(a*x.v,a);}
+    friend adouble operator/(const adouble& x, const adouble& y){double z = x.v/y.v; return chain(x,y,z,1/y.v,-z/y.v);}
+    friend adouble operator/(const adouble& x, double a){return x.chain(x.v/a,1/a);}
+    friend adouble operator/(double a, const adouble& x){double z = a/x.v; return x.chain(z,-z/x.v);}
+    friend adouble& operator+=(adouble& x, const adouble& y){return x = x+y;}
+    friend adouble& operator-=(adouble& x, const adouble& y){return x = x-y;}
+    friend adouble& operator*=(adouble& x, const adouble& y){return x = x*y;}
+    friend adouble& operator/=(adouble& x, const adouble& y){return x = x/y;}
+    friend bool operator<(const adouble& x, const adouble& y){return x.v<y.v;}
+    friend bool operator>(const adouble& x, const adouble& y){return x.v>y.v;}
+    friend bool operator<=(const adouble& x, const adouble& y){return x.v<=y.v;}
+    friend bool operator>=(const adouble& x, const adouble& y){return x.v>=y.v;}
+    friend adouble max(const adouble& x, const adouble& y){ // ties take the mean of both one-sided derivatives
+        if(x.v!=y.v) return (x.v<y.v)?y:x;
+        return chain(x,y,x.v,.5,.5);
+    }
+    friend ostream& operator<<(ostream& out, const adouble& x){return out << x.v;}
+};
+
+inline double primal(const adouble& x){return x.v;}
+inline adouble exp(const adouble& x){double e = exp(x.v); return x.chain(e,e);}
+inline adouble log(const adouble& x){return x.chain(log(x.v),1/x.v);}
+inline adouble sqrt(const adouble& x){double s = sqrt(x.v); return x.chain(s,.5/s);}
+inline adouble pow(const adouble& x, double a){double p = pow(x.v,a); return x.chain(p,a*p/x.v);}
+inline adouble fabs(const adouble& x){return x.chain(fabs(x.v),(x.v>0)-(x.v<0));}
+inline adouble normalCDF(const adouble& x){return x.chain(normalCDF(x.v),normalPDF(x.v));}
+inline adouble normalPDF(const adouble& x){double p = normalPDF(x.v); return x.chain(p,-x.v*p);}
+
+#endif
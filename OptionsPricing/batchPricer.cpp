@@ -0,0 +1,245 @@
+//
+//  batchPricer.cpp
+//  OptionsPricing
+//
+
+#include "batchPricer.hpp"
+#include "logger.cpp"
+#include <chrono>
+
+#ifndef BATCHPRICER
+#define BATCHPRICER
+
+typedef Array<double,Dynamic,1,0,BATCH_CHUNK,1> BatchArray; // stack storage, at most one chunk
+typedef Array<bool,Dynamic,1,0,BATCH_CHUNK,1> BatchMask;
+
+template<class Derived, class Density>
+inline BatchArray fastNormalCDF(const ArrayBase<Derived>& x, const ArrayBase<Density>& gauss){
+    // Hart (1968) rational approximation of the lower tail given gauss=exp(-x^2/2), double accurate and
+    // branch-free so that it vectorises; the rational keeps the Mills ratio asymptotics beyond |x|>7.07
+    BatchArray a = x.abs();
+    BatchArray num = ((((((3.52624965998911e-02*a+0.700383064443688)*a+6.37396220353165)*a
+                          +33.912866078383)*a+112.079291497871)*a+221.213596169931)*a+220.206867912376);
+    BatchArray den = (((((((8.83883476483184e-02*a+1.75566716318264)*a+16.064177579207)*a
+                           +86.7807322029461)*a+296.564248779674)*a+637.333633378831)*a
+                        +793.826512519948)*a+440.413735824752);
+    BatchArray tail = gauss*num/den;
+    return (x>0).select(1-tail,tail);
+}
+
+BatchPricer::BatchPricer(OptionType type, int n){
+    this->type = type;
+    for(auto v:{&spot,&strike,&maturity,&riskFreeRate,&dividendYield,&volatility,&callPut}) v->reserve(n);
+}
+
+int BatchPricer::addOption(double S0, double K, double T, double r, double q, double sig, bool isCall){
+    spot.push_back(S0);
+    strike.push_back(K);
+    maturity.push_back(T);
+    riskFreeRate.push_back(r);
+    dividendYield.push_back(q);
+    volatility.push_back(sig);
+    callPut.push_back(isCall?1:-1);
+    return size()-1;
+}
+
+int BatchPricer::addOption(const Option& option, const Market& market){
+    const Stock& stock = market.getStock();
+    return addOption(stock.getCurrentPrice(),option.getStrike(),option.getMaturity(),market.getRiskFreeRate(),
+                     stock.getDividendYield(),stock.getVolatility(),option.getPutCallId()==CALL);
+}
+
+void BatchPricer::calcPrices(double *prices, int i0, int i1) const {
+    // European: w*(S*exp(-qT)*N(w*d1)-K*exp(-rT)*N(w*d2)), Digital: exp(-rT)*N(w*d2), w=+1/-1 call/put
+    for(int c=i0; c<i1; c+=BATCH_CHUNK){
+        int m = min(BATCH_CHUNK,i1-c);
+        Map<const ArrayXd> S(&spot[c],m), K(&strike[c],m), T(&maturity[c],m),
+        r(&riskFreeRate[c],m), q(&dividendYield[c],m), sig(&volatility[c],m), w(&callPut[c],m);
+        Map<ArrayXd> V(prices+c-i0,m);
+        BatchArray sigT = sig*T.sqrt();
+        BatchArray d1 = ((S/K).log()+(r-q+0.5*sig*sig)*T)/sigT, d2 = d1-sigT;
+        BatchArray discR = (-r*T).exp(), fwdS = S*(-q*T).exp();
+        // one exp for both densities: fwdS*n(d1) = K*discR*n(d2)
+        BatchArray gauss1 = (-0.5*d1*d1).exp(), gauss2 = gauss1*fwdS/(K*discR);
+        if(type==DIGITAL) V = discR*fastNormalCDF(w*d2,gauss2);
+        else V = w*(fwdS*fastNormalCDF(w*d1,gauss1)-K*discR*fastNormalCDF(w*d2,gauss2));
+    }
+}
+
+vector<double> BatchPricer::calcPrices(int numThreads) const {
+    // chunks are independent, threads take them in turn
+    int n = size();
+    vector<double> prices(n);
+    int numChunks = (n+BATCH_CHUNK-1)/BATCH_CHUNK;
+    parallelFor(numChunks,[&](int c){
+        int i0 = c*BATCH_CHUNK;
+        calcPrices(&prices[i0],i0,min(i0+BATCH_CHUNK,n));
+    },numThreads);
+    return prices;
+}
+
+void BatchPricer::calcGreeks(BatchGreeks& greeks, int i0, int i1) const {
+    // same intermediates as calcPrices, see Pricer::BlackScholesGreeks for the scalar formulas
+    for(int c=i0; c<i1; c+=BATCH_CHUNK){
+        int m = min(BATCH_CHUNK,i1-c);
+        Map<const ArrayXd> S(&spot[c],m), K(&strike[c],m), T(&maturity[c],m),
+        r(&riskFreeRate[c],m), q(&dividendYield[c],m), sig(&volatility[c],m), w(&callPut[c],m);
+        Map<ArrayXd> V(&greeks.price[c],m), delta(&greeks.delta[c],m), gamma(&greeks.gamma[c],m),
+        vega(&greeks.vega[c],m), rho(&greeks.rho[c],m), theta(&greeks.theta[c],m),
+        vanna(&greeks.vanna[c],m), volga(&greeks.volga[c],m), charm(&greeks.charm[c],m);
+        BatchArray sqrtT = T.sqrt(), sigT = sig*sqrtT;
+        BatchArray d1 = ((S/K).log()+(r-q+0.5*sig*sig)*T)/sigT, d2 = d1-sigT;
+        BatchArray discR = (-r*T).exp(), discQ = (-q*T).exp(), fwdS = S*discQ;
+        BatchArray gauss1 = (-0.5*d1*d1).exp(), gauss2 = gauss1*fwdS/(K*discR);
+        BatchArray Nd1 = fastNormalCDF(w*d1,gauss1), Nd2 = fastNormalCDF(w*d2,gauss2);
+        BatchArray dd2_dT = (r-q-0.5*sig*sig)/sigT-d2/(2*T);
+        if(type==DIGITAL){
+            BatchArray n2 = discR*gauss2/sqrt(2*M_PI); // discounted density
+            V = discR*Nd2;
+            delta = w*n2/(S*sigT);
+            gamma = -delta*d1/(S*sigT);
+            vega = -w*n2*d1/sig;
+            rho = -T*V+w*n2*sqrtT/sig;
+            theta = r*V-w*n2*dd2_dT;
+            vanna = delta*(d1*d2-1)/sig;
+            volga = -w*n2*(d1*d1*d2-d1-d2)/(sig*sig);
+            charm = delta*(r+d2*dd2_dT+0.5/T);
+        }else{
+            BatchArray n1 = discQ*gauss1/sqrt(2*M_PI); // dividend-discounted density
+            BatchArray KNd2 = K*discR*Nd2;
+            V = w*(fwdS*Nd1-KNd2);
+            delta = w*discQ*Nd1;
+            gamma = n1/(S*sigT);
+            vega = S*n1*sqrtT;
+            rho = w*T*KNd2;
+            theta = -S*n1*sig/(2*sqrtT)+w*(q*fwdS*Nd1-r*KNd2);
+            vanna = -n1*d2/sig;
+            volga = vega*d1*d2/sig;
+            charm = q*delta-n1*(dd2_dT+sig/(2*sqrtT));
+        }
+    }
+}
+
+BatchGreeks BatchPricer::calcGreeks(int numThreads) const {
+    int n = size();
+    BatchGreeks greeks(n);
+    int numChunks = (n+BATCH_CHUNK-1)/BATCH_CHUNK;
+    parallelFor(numChunks,[&](int c){
+        int i0 = c*BATCH_CHUNK;
+        calcGreeks(greeks,i0,min(i0+BATCH_CHUNK,n));
+    },numThreads);
+    return greeks;
+}
+
+template<class Derived>
+inline BatchArray fastNormalInvCDF(const ArrayBase<Derived>& p){
+    // Acklam's rational approximation (relative error 1.15e-9), both regions evaluated then selected
+    BatchArray u = p.min(1-p), t = p-0.5, t2 = t*t, v = (-2*u.log()).sqrt();
+    BatchArray central = (((((-3.969683028665376e+01*t2+2.209460984245205e+02)*t2-2.759285104469687e+02)*t2
+                            +1.383577518672690e+02)*t2-3.066479806614716e+01)*t2+2.506628277459239e+00)*t/
+    (((((-5.447609879822406e+01*t2+1.615858368580409e+02)*t2-1.556989798598866e+02)*t2
+       +6.680131188771972e+01)*t2-1.328068155288572e+01)*t2+1);
+    BatchArray tail = (((((-7.784894002430293e-03*v-3.223964580411365e-01)*v-2.400758277161838e+00)*v
+                         -2.549732539343734e+00)*v+4.374664141464968e+00)*v+2.938163982698783e+00)/
+    ((((7.784695709041462e-03*v+3.224671290700398e-01)*v+2.445134137142996e+00)*v+3.754408661907416e+00)*v+1);
+    return (u<0.02425).select((p>0.5).select(-tail,tail),central);
+}
+
+template<class Derived>
+inline void normalisedBlackPrices(const ArrayBase<Derived>& x, const BatchArray& s, BatchArray& b, BatchArray& vega){
+    // vectorised normalisedBlackPrice of pricer.cpp with its derivative in s, one exp for both densities
+    BatchArray d1 = x/s+0.5*s, gauss1 = (-0.5*d1*d1).exp(), ex = (0.5*x).exp();
+    b = ex*fastNormalCDF(d1,gauss1)-fastNormalCDF(d1-s,gauss1*x.exp())/ex;
+    vega = ex*gauss1/sqrt(2*M_PI);
+}
+
+void BatchPricer::calcImpliedVolatilities(double *vols, const double *prices, int i0, int i1) const {
+    // Pricer::BlackScholesImpliedVolatility on whole chunks: the same branch guesses and Householder steps
+    // run on every lane, converged lanes are frozen and the loop ends when all of them are
+    for(int c=i0; c<i1; c+=BATCH_CHUNK){
+        int m = min(BATCH_CHUNK,i1-c);
+        Map<const ArrayXd> S(&spot[c],m), K(&strike[c],m), T(&maturity[c],m),
+        r(&riskFreeRate[c],m), q(&dividendYield[c],m), w(&callPut[c],m), V(prices+c-i0,m);
+        Map<ArrayXd> vol(vols+c-i0,m);
+        BatchArray F = S*((r-q)*T).exp(), scale = (-r*T).exp()*(F*K).sqrt(), logFK = (F/K).log();
+        BatchArray beta = V/scale-(w*((0.5*logFK).exp()-(-0.5*logFK).exp())).max(0.);
+        BatchArray x = -logFK.abs(), ax = logFK.abs(), ex = (0.5*x).exp(), logBeta = beta.log();
+        BatchArray tol = 1e-15*V/scale; // machine precision in the option price
+        BatchMask valid = (beta>0)&&(beta<ex)&&(T>0);
+        if(type!=EUROPEAN) valid.setConstant(false);
+        // initial guesses, see impliedNormalisedVolatility
+        BatchArray sc = (2*ax).sqrt(), su = -2*fastNormalInvCDF((ex-beta)/(ex+1/ex));
+        BatchArray sl = ax/(-2*logBeta).sqrt();
+        for(int k=0; k<2; k++){
+            BatchArray rhs = 3*sl.log()-2*ax.log()-0.5*log(2*M_PI)-sl*sl/8-logBeta;
+            sl = (rhs>0).select(ax/(2*rhs).sqrt(),sl);
+        }
+        sl = (sl>0).select(sl.min(sc),sc);
+        BatchArray b, vega, bc, vc, bl, vl, bu, vu;
+        normalisedBlackPrices(x,sc,bc,vc);
+        normalisedBlackPrices(x,sl,bl,vl);
+        normalisedBlackPrices(x,su,bu,vu);
+        BatchMask lower = beta<bc;
+        // lower branch: closest of the three guesses in log price, upper branch: su if above sc
+        BatchArray el = (bl.log()-logBeta).abs(), eu = (su<=sc).select((bu.log()-logBeta).abs(),INFINITY),
+        ec = (bc.log()-logBeta).abs();
+        BatchMask useL = lower&&(el<=eu)&&(el<=ec), useU = lower.select((eu<el)&&(eu<=ec),su>sc);
+        BatchArray s = useL.select(sl,useU.select(su,sc));
+        b = useL.select(bl,useU.select(bu,bc));
+        vega = useL.select(vl,useU.select(vu,vc));
+        BatchArray lo = BatchArray::Zero(m), hi = BatchArray::Constant(m,INFINITY);
+        BatchMask done = !valid;
+        for(int n=0; n<100; n++){
+            BatchArray h2 = x*x/(s*s*s)-0.25*s, h3 = h2*h2-3*x*x/(s*s*s*s)-0.25;
+            hi = (b>beta).select(hi.min(s),hi);
+            lo = (b>beta).select(lo,lo.max(s));
+            BatchArray L1 = vega/b, L2 = h2*L1-L1*L1, L3 = h3*L1-3*h2*L1*L1+2*L1*L1*L1;
+            BatchArray nu = lower.select(-(b.log()-logBeta)/L1,-(b-beta)/vega);
+            h2 = lower.select(L2/L1,h2);
+            h3 = lower.select(L3/L1,h3);
+            BatchArray ds = nu*(1+0.5*h2*nu)/(1+nu*(h2+h3*nu/6)), sn = s+ds;
+            BatchMask converged = ds.abs()<=1e-7*s; // see impliedNormalisedVolatility
+            sn = (converged||((sn>lo)&&(sn<hi))).select(sn,hi.isInf().select(2*s,0.5*(lo+hi)));
+            done = done||((b-beta).abs()<=tol);
+            s = done.select(s,sn);
+            done = done||converged;
+            if(done.all()) break;
+            normalisedBlackPrices(x,s,b,vega);
+        }
+        vol = valid.select(s/T.sqrt(),NAN);
+    }
+}
+
+vector<double> BatchPricer::calcImpliedVolatilities(const vector<double>& prices, int numThreads) const {
+    // one market price per contract, volatilities are ignored; NaN outside the no-arbitrage bounds
+    int n = size();
+    vector<double> vols(n);
+    int numChunks = (n+BATCH_CHUNK-1)/BATCH_CHUNK;
+    parallelFor(numChunks,[&](int c){
+        int i0 = c*BATCH_CHUNK;
+        calcImpliedVolatilities(&vols[i0],&prices[i0],i0,min(i0+BATCH_CHUNK,n));
+    },numThreads);
+    return vols;
+}
+
+double BatchPricer::benchmark(int n, int numRuns, OptionType type){
+    // options priced per second on one thread over random contracts, best of numRuns
+    mt19937_64 gen(1);
+    uniform_real_distribution<double> U(0,1);
+    BatchPricer batch(type,n);
+    for(int i=0; i<n; i++)
+        batch.addOption(80+40*U(gen),100,0.1+2*U(gen),0.05*U(gen),0.03*U(gen),0.1+0.4*U(gen),U(gen)<0.5);
+    vector<double> prices(n);
+    double best = INFINITY;
+    for(int k=0; k<numRuns; k++){
+        auto t0 = chrono::steady_clock::now();
+        batch.calcPrices(&prices[0],0,n);
+        best = min(best,chrono::duration<double>(chrono::steady_clock::now()-t0).count());
+    }
+    double rate = n/best;
+    if(GUI) logMessage(LOG_INFO,"BatchPricer::benchmark {} options, {}M options/s (checksum {})",
+                       n,rate/1e6,accumulate(prices.begin(),prices.end(),0.));
+    return rate;
+}
+
+#endif
@@ -0,0 +1,47 @@
+//
+//  batchPricer.hpp
+//  OptionsPricing
+//
+
+#ifndef batchPricer_hpp
+#define batchPricer_hpp
+
+#include "option.h"
+#include "market.hpp"
+#include <stdio.h>
+
+using namespace std;
+
+#define BATCH_CHUNK 256
+
+struct BatchGreeks{
+    // structure-of-arrays counterpart of Greeks, one entry per contract
+    vector<double> price, delta, gamma, vega, rho, theta, vanna, volga, charm;
+    BatchGreeks(int n=0){for(auto v:{&price,&delta,&gamma,&vega,&rho,&theta,&vanna,&volga,&charm}) v->resize(n);}
+};
+
+class BatchPricer{
+    // closed-form Black-Scholes over arrays of European or Digital contracts, structure-of-arrays
+    // inputs are priced in cache-sized chunks by vectorised Eigen array expressions
+public:
+    OptionType type;
+    vector<double> spot, strike, maturity, riskFreeRate, dividendYield, volatility;
+    vector<double> callPut; // +1 for call, -1 for put
+    /**** constructors ****/
+    BatchPricer(OptionType type=EUROPEAN, int n=0);
+    /**** accessors ****/
+    int size() const {return (int)spot.size();}
+    /**** mutators ****/
+    int addOption(double S0, double K, double T, double r, double q, double sig, bool isCall);
+    int addOption(const Option& option, const Market& market);
+    /**** main ****/
+    void calcPrices(double *prices, int i0, int i1) const;
+    vector<double> calcPrices(int numThreads=1) const;
+    void calcGreeks(BatchGreeks& greeks, int i0, int i1) const;
+    BatchGreeks calcGreeks(int numThreads=1) const;
+    void calcImpliedVolatilities(double *vols, const double *prices, int i0, int i1) const;
+    vector<double> calcImpliedVolatilities(const vector<double>& prices, int numThreads=1) const;
+    static double benchmark(int n=1<<20, int numRuns=20, OptionType type=EUROPEAN);
+};
+
+#endif /* batchPricer_hpp */
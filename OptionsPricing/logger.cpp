@@ -0,0 +1,274 @@
+//
+//  logger.cpp
+//  OptionsPricing
+//
+
+// leveled asynchronous logger: callers stage raw records in a lock-free ring, one background thread formats and writes them
+#ifndef LOGGER
+#define LOGGER
+#include "util.cpp"
+#include <chrono>
+#include <mutex>
+
+using namespace std;
+
+#ifndef LOG
+#define LOG true
+#endif
+
+#define LOG_MAX_ARGS 8
+#define LOG_RING_SIZE 4096 // power of 2
+
+enum LogLevel {LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_NONE};
+
+const vector<string> LOG_LEVEL_NAMES{"debug","info","warn","error","none"};
+
+inline LogLevel parseLogLevel(string name, LogLevel level=LOG_INFO){
+    // level by its name, level if the name is unknown
+    for(int k=0; k<(int)LOG_LEVEL_NAMES.size(); k++)
+        if(name==LOG_LEVEL_NAMES[k]) return (LogLevel)k;
+    return level;
+}
+
+struct LogArg{
+    // argument kept raw until the record is written, strings as a range of the text of the record
+    enum Type {INT, UINT, DOUBLE, BOOL, TEXT} type;
+    union {long long i; unsigned long long u; double d;};
+    size_t begin, end;
+};
+
+struct LogRecord{
+    LogLevel level;
+    long long time; // microseconds since epoch
+    int thread;
+    const char *fmt; // string literal, "{}" marks each argument
+    int numArgs;
+    LogArg args[LOG_MAX_ARGS];
+    string text; // reused across records, so that its capacity stays
+};
+
+class Logger{
+    // multi-producer single-consumer ring of records with a sequence number per slot (Vyukov): producers claim
+    // a slot with one compare-and-swap and publish it with a release store, the writer thread takes slots in
+    // order; a full ring makes producers wait rather than drop records
+private:
+    struct Slot{atomic<size_t> seq; LogRecord record;};
+    vector<Slot> ring;
+    atomic<size_t> tail; // next slot to claim
+    atomic<size_t> head; // next slot to write, advanced by the writer thread only
+    atomic<int> level;
+    atomic<bool> json, running, stopping;
+    atomic<long> numWritten;
+    atomic<ostream*> out;
+    long long lastSec = -1; // time stamps of the last second written, writer thread only
+    char stamp[32], isoStamp[32];
+    thread writer;
+    mutex startLock; // only taken to start the writer thread
+    /**** helpers ****/
+    void _start();
+    void _run();
+    bool _writeNext();
+    void _writeRecord(const LogRecord& record);
+    static int _threadId(){static atomic<int> next(0); static thread_local int id = next++; return id;}
+    static void _setArg(LogRecord& r, int k, long long v){r.args[k].type = LogArg::INT; r.args[k].i = v;}
+    static void _setArg(LogRecord& r, int k, unsigned long long v){r.args[k].type = LogArg::UINT; r.args[k].u = v;}
+    static void _setArg(LogRecord& r, int k, int v){_setArg(r,k,(long long)v);}
+    static void _setArg(LogRecord& r, int k, long v){_setArg(r,k,(long long)v);}
+    static void _setArg(LogRecord& r, int k, unsigned v){_setArg(r,k,(unsigned long long)v);}
+    static void _setArg(LogRecord& r, int k, unsigned long v){_setArg(r,k,(unsigned long long)v);}
+    static void _setArg(LogRecord& r, int k, double v){r.args[k].type = LogArg::DOUBLE; r.args[k].d = v;}
+    static void _setArg(LogRecord& r, int k, bool v){r.args[k].type = LogArg::BOOL; r.args[k].i = v;}
+    static void _setArg(LogRecord& r, int k, const char *v){
+        r.args[k].type = LogArg::TEXT;
+        r.args[k].begin = r.text.size();
+        r.text += v;
+        r.args[k].end = r.text.size();
+    }
+    static void _setArg(LogRecord& r, int k, const string& v){_setArg(r,k,v.c_str());}
+    template <class T>
+    static void _setArg(LogRecord& r, int k, const T& v){ // anything else is printed on the calling thread
+        ostringstream oss;
+        oss << v;
+        _setArg(r,k,oss.str());
+    }
+    static void _setArgs(LogRecord& r, int k){r.numArgs = k;}
+    template <class T, class... Args>
+    static void _setArgs(LogRecord& r, int k, const T& v, const Args&... args){
+        _setArg(r,k,v);
+        _setArgs(r,k+1,args...);
+    }
+public:
+    /**** constructors ****/
+    Logger(LogLevel level=LOG_INFO);
+    ~Logger();
+    static Logger& global(); // level from the environment variable OPTIONS_PRICING_LOG, if set
+    /**** accessors ****/
+    LogLevel getLevel() const {return (LogLevel)level.load(memory_order_relaxed);}
+    bool isEnabled(LogLevel level) const {return level>=this->level.load(memory_order_relaxed);}
+    bool isJson() const {return json;}
+    long getNumWritten() const {return numWritten;}
+    /**** mutators ****/
+    LogLevel setLevel(LogLevel level){this->level = level; return level;}
+    bool setJson(bool json){flush(); return this->json = json;} // one JSON object per line instead of text
+    ostream* setOutput(ostream* out){flush(); return this->out = out;}
+    /**** main ****/
+    template <class... Args>
+    void log(LogLevel level, const char *fmt, const Args&... args);
+    void flush(); // wait until every record logged before the call is written
+};
+
+Logger::Logger(LogLevel level):ring(LOG_RING_SIZE),tail(0),head(0),level(level),json(false),running(false),stopping(false),numWritten(0),out(&cout){
+    for(size_t k=0; k<ring.size(); k++) ring[k].seq.store(k,memory_order_relaxed);
+}
+
+Logger::~Logger(){
+    if(running){
+        stopping = true;
+        writer.join();
+    }
+}
+
+Logger& Logger::global(){
+    static Logger logger(getenv("OPTIONS_PRICING_LOG")?parseLogLevel(getenv("OPTIONS_PRICING_LOG")):LOG_INFO);
+    return logger;
+}
+
+template <class... Args>
+void Logger::log(LogLevel level, const char *fmt, const Args&... args){
+    static_assert(sizeof...(Args)<=LOG_MAX_ARGS,"too many log arguments");
+    if(!isEnabled(level)) return;
+    if(!running) _start();
+    size_t mask = ring.size()-1;
+    size_t pos = tail.load(memory_order_relaxed);
+    Slot *slot;
+    while(true){
+        slot = &ring[pos&mask];
+        size_t seq = slot->seq.load(memory_order_acquire);
+        long diff = (long)seq-(long)pos;
+        if(diff==0){
+            if(tail.compare_exchange_weak(pos,pos+1,memory_order_relaxed)) break;
+        }else if(diff<0){ // full
+            this_thread::yield();
+            pos = tail.load(memory_order_relaxed);
+        }else pos = tail.load(memory_order_relaxed);
+    }
+    LogRecord& r = slot->record;
+    r.level = level;
+    r.time = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    r.thread = _threadId();
+    r.fmt = fmt;
+    r.text.clear();
+    _setArgs(r,0,args...);
+    slot->seq.store(pos+1,memory_order_release);
+}
+
+void Logger::flush(){
+    if(!running) return;
+    size_t pos = tail.load(memory_order_acquire);
+    while(head.load(memory_order_acquire)<pos) this_thread::yield();
+}
+
+void Logger::_start(){
+    lock_guard<mutex> guard(startLock);
+    if(running) return;
+    writer = thread([this](){_run();});
+    running = true;
+}
+
+void Logger::_run(){
+    // write whatever is ready, flush the stream once the ring runs dry
+    while(true){
+        bool stop = stopping;
+        int n = 0;
+        while(_writeNext()) n++;
+        if(n>0) out.load()->flush();
+        if(stop) break;
+        if(n==0) this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+bool Logger::_writeNext(){
+    size_t pos = head.load(memory_order_relaxed);
+    Slot& slot = ring[pos&(ring.size()-1)];
+    if(slot.seq.load(memory_order_acquire)!=pos+1) return false;
+    _writeRecord(slot.record);
+    slot.seq.store(pos+ring.size(),memory_order_release);
+    head.store(pos+1,memory_order_release);
+    numWritten++;
+    return true;
+}
+
+void Logger::_writeRecord(const LogRecord& r){
+    long long sec = r.time/1000000;
+    if(sec!=lastSec){
+        time_t t = (time_t)sec;
+        tm local = *localtime(&t);
+        strftime(stamp,sizeof(stamp),"%Y%m%d %T",&local);
+        strftime(isoStamp,sizeof(isoStamp),"%Y-%m-%dT%T",&local);
+        lastSec = sec;
+    }
+    ostream& out = *this->out.load();
+    char buf[64];
+    string msg, args;
+    auto argStr = [&](const LogArg& a) -> string {
+        switch(a.type){
+            case LogArg::INT: snprintf(buf,sizeof(buf),"%lld",a.i); return buf;
+            case LogArg::UINT: snprintf(buf,sizeof(buf),"%llu",a.u); return buf;
+            case LogArg::DOUBLE: snprintf(buf,sizeof(buf),"%f",a.d); return buf;
+            case LogArg::BOOL: return a.i?"true":"false";
+            default: return r.text.substr(a.begin,a.end-a.begin);
+        }
+    };
+    int k = 0;
+    for(const char *p=r.fmt; *p; p++){
+        if(p[0]=='{' && p[1]=='}' && k<r.numArgs){
+            msg += argStr(r.args[k++]);
+            p++;
+        }else msg += *p;
+    }
+    if(!json){
+        out << stamp << " [" << LOG_LEVEL_NAMES[r.level] << "] " << msg << '\n';
+        return;
+    }
+    auto quote = [](const string& s){
+        // JSON string: quote and backslash escaped, every control character as \u00XX
+        string q = "\"";
+        char hex[8];
+        for(char c:s){
+            if(c=='"' || c=='\\'){
+                q += '\\';
+                q += c;
+            }else if((unsigned char)c<0x20){
+                snprintf(hex,sizeof(hex),"\\u%04x",(unsigned char)c);
+                q += hex;
+            }else q += c;
+        }
+        return q+"\"";
+    };
+    for(int j=0; j<r.numArgs; j++){
+        const LogArg& a = r.args[j];
+        if(a.type==LogArg::DOUBLE){
+            snprintf(buf,sizeof(buf),"%.17g",a.d);
+            args += isfinite(a.d)?buf:quote(buf);
+        }else if(a.type==LogArg::TEXT) args += quote(argStr(a));
+        else args += argStr(a);
+        if(j<r.numArgs-1) args += ",";
+    }
+    snprintf(buf,sizeof(buf),".%06lld",r.time%1000000);
+    out << "{" <<
+    "\"time\":\""  << isoStamp << buf << "\"," <<
+    "\"level\":\"" << LOG_LEVEL_NAMES[r.level] << "\"," <<
+    "\"thread\":"  << r.thread << "," <<
+    "\"msg\":"     << quote(msg) << "," <<
+    "\"fmt\":"     << quote(r.fmt) << "," <<
+    "\"args\":["   << args << "]" <<
+    "}\n";
+}
+
+template <class... Args>
+inline void logMessage(LogLevel level, const char *fmt, const Args&... args){
+    // a record below the level of the global logger costs one load, LOG false compiles every record out
+    if(LOG && Logger::global().isEnabled(level)) Logger::global().log(level,fmt,args...);
+}
+
+#endif
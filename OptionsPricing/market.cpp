@@ -10,27 +10,36 @@
 #ifndef MARKET
 #define MARKET
 
+Market::Market(){
+    this->riskFreeRate = 0;
+    this->stockPtr = make_shared<Stock>();
+    this->stocksPtr = make_shared<vector<Stock>>();
+    this->corMatrixPtr = this->corFactorPtr = make_shared<matrix>();
+}
+
 Market::Market(double riskFreeRate, const Stock& stock, const vector<Stock>& stocks, const matrix& corMatrix){
     this->riskFreeRate = riskFreeRate;
-    this->stock = stock;
-    this->stocks = stocks;
-    this->corMatrix = corMatrix;
+    setStock(stock);
+    setStocks(stocks);
+    setCorMatrix(corMatrix);
 }
 
 Market::Market(const Market& market){
+    // O(1): snapshots are shared, not deep-copied
     this->riskFreeRate = market.riskFreeRate;
-    this->stock = market.stock;
-    this->stocks = market.stocks;
-    this->corMatrix = market.corMatrix;
+    this->stockPtr = market.stockPtr;
+    this->stocksPtr = market.stocksPtr;
+    this->corMatrixPtr = market.corMatrixPtr;
+    this->corFactorPtr = market.corFactorPtr;
 }
 
 string Market::getAsJson() const {
     ostringstream oss;
     oss << "{" <<
     "\"riskFreeRate\":"   << riskFreeRate << "," <<
-    "\"stock\":"          << stock        << "," <<
-    "\"stocks\":"         << stocks       << "," <<
-    "\"corMatrix\":"      << corMatrix    <<
+    "\"stock\":"          << getStock()     << "," <<
+    "\"stocks\":"         << getStocks()    << "," <<
+    "\"corMatrix\":"      << getCorMatrix() <<
     "}";
     return oss.str();
 }
@@ -41,18 +50,33 @@ double Market::setRiskFreeRate(double riskFreeRate){
 }
 
 Stock Market::setStock(const Stock& stock, int i){
-    if(i<0) this->stock = stock;
-    else this->stocks[i] = stock;
+    if(i<0) this->stockPtr = make_shared<Stock>(stock);
+    else{
+        vector<Stock> stocks = getStocks();
+        stocks[i] = stock;
+        setStocks(stocks);
+    }
     return stock;
 }
 
+Stock& Market::editStock(int i){
+    // in-place access for parameter updates, the snapshot is cloned first only while another copy shares it
+    if(i<0){
+        if(stockPtr.use_count()>1) stockPtr = make_shared<Stock>(*stockPtr);
+        return const_cast<Stock&>(*stockPtr);
+    }
+    if(stocksPtr.use_count()>1) stocksPtr = make_shared<vector<Stock>>(*stocksPtr);
+    return const_cast<Stock&>((*stocksPtr)[i]);
+}
+
 vector<Stock> Market::setStocks(const vector<Stock>& stocks){
-    this->stocks = stocks;
+    this->stocksPtr = make_shared<vector<Stock>>(stocks);
     return stocks;
 }
 
 matrix Market::setCorMatrix(const matrix& corMatrix){
-    this->corMatrix = corMatrix;
+    this->corMatrixPtr = make_shared<matrix>(corMatrix);
+    this->corFactorPtr = make_shared<matrix>(corMatrix.isEmpty()?NULL_MATRIX:corMatrix.chol()); // Choleskey decomposition, once per matrix
     return corMatrix;
 }
 
@@ -62,6 +86,8 @@ vector<matrix> Market::simulateCorrelatedPrices(const SimulationConfig& config,
 }
 
 vector<vector<matrix>> Market::simulateCorrelatedPricesWithFullCalc(const SimulationConfig& config, int numSim, const vector<matrix>& randomMatrixSet){
+    vector<Stock> stocks = getStocks(); // sim outputs are published as a new snapshot
+    const matrix& corFactor = getCorFactor();
     int n = config.iters;
     int m = (int)stocks.size();
     double dt = config.stepSize;
@@ -81,8 +107,20 @@ vector<vector<matrix>> Market::simulateCorrelatedPricesWithFullCalc(const Simula
         simPriceVectorSet.push_back(simPriceVector);
         simPriceMatrixSet.push_back(simPriceMatrix);
     }
-    matrix corFactor = corMatrix.chol(); // Choleskey decomposition
     string dynamics = stocks[0].getDynamics();
+    if(randomMatrixSet.empty()){
+        vector<PathBuffer> simPathsSet = simulateCorrelatedPricePaths(config,numSim);
+        if(!simPathsSet.empty()){
+            simTimeVector.setRange(0,n*dt,n,true);
+            for(int j=0; j<m; j++){
+                simPriceMatrixSet[j] = simPathsSet[j].toMatrix();
+                stocks[j].setSimTimeVector(simTimeVector);
+                stocks[j].setSimPriceMatrix(simPriceMatrixSet[j]);
+            }
+            setStocks(stocks);
+            return {simPriceMatrixSet};
+        }
+    }
     if(dynamics=="lognormal"){
         for(int i=1; i<n+1; i++){
             matrix iidRandomMatrix(m,numSim);
@@ -102,9 +140,124 @@ vector<vector<matrix>> Market::simulateCorrelatedPricesWithFullCalc(const Simula
             stocks[j].setSimTimeVector(simTimeVector);
             stocks[j].setSimPriceMatrix(simPriceMatrixSet[j]);
         }
+        setStocks(stocks);
     }else if(dynamics=="jump-diffusion"){} // TO DO
     else if(dynamics=="Heston"){} // TO DO
     return {simPriceMatrixSet};
 }
 
+vector<PathBuffer> Market::simulateCorrelatedPricePaths(const SimulationConfig& config, int numSim){
+    // all assets share one layout; every block is cut into chunks of at most MULTI_STOCK_CHUNK paths,
+    // each simulated by simulateCorrelatedBlock on its own generator seeded by (seed, first path)
+    int n = config.iters;
+    int m = (int)getStocks().size();
+    vector<PathBuffer> simPathsSet(m,PathBuffer(n+1,numSim,config.pathLayout,config.tilePaths));
+    if(m==0) return {};
+    vector<pair<int,int>> chunks; // (block, offset within block)
+    for(int b=0; b<simPathsSet[0].getNumBlocks(); b++)
+        for(int k=0; k<simPathsSet[0].getBlock(b).width; k+=MULTI_STOCK_CHUNK)
+            chunks.push_back({b,k});
+    unsigned long seed = config.seed?config.seed:rand();
+    atomic<bool> simulated(true);
+    parallelFor((int)chunks.size(),[&](int c){
+        vector<PathBlock> blocks(m);
+        for(int a=0; a<m; a++){
+            PathBlock block = simPathsSet[a].getBlock(chunks[c].first);
+            int k = chunks[c].second;
+            block.data += (size_t)k*block.pathStride;
+            block.path0 += k;
+            block.width = min(MULTI_STOCK_CHUNK,block.width-k);
+            blocks[a] = block;
+        }
+        mt19937_64 gen = randomEngine(seed,blocks[0].path0);
+        if(!simulateCorrelatedBlock(config,blocks,gen)) simulated = false;
+    },config.numThreads);
+    if(!simulated) return {};
+    return simPathsSet;
+}
+
+bool Market::simulateCorrelatedBlock(const SimulationConfig& config, const vector<PathBlock>& blocks, mt19937_64& gen, double sign) const {
+    // fused step: draw iid normals for all assets, correlate by the cached lower factor,
+    // advance each asset under its own dynamics ("lognormal", Merton "jump-diffusion", "Heston")
+    // sign=-1 negates every normal draw, giving the antithetic of a run on the same generator state
+    const vector<Stock>& stocks = getStocks();
+    const matrix& corFactor = getCorFactor();
+    int m = (int)stocks.size();
+    int n = blocks[0].steps;
+    int w = blocks[0].width;
+    double dt = config.stepSize;
+    double sqrt_dt = sqrt(dt);
+    vector<double> L(m*m,0.);
+    for(int a=0; a<m; a++)
+        for(int b=0; b<=a; b++)
+            L[a*m+b] = corFactor.isEmpty()?(a==b):corFactor.getEntry(a,b);
+    vector<int> model(m);
+    vector<vector<double>> dynParamsSet(m);
+    for(int a=0; a<m; a++){
+        string dynamics = stocks[a].getDynamics();
+        dynParamsSet[a] = stocks[a].getDynParams();
+        if(dynamics=="lognormal") model[a] = 0;
+        else if(dynamics=="jump-diffusion") model[a] = 1;
+        else if(dynamics=="Heston") model[a] = 2;
+        else return false;
+    }
+    normal_distribution<double> normal;
+    vector<double> Z((size_t)m*w), X((size_t)m*w), Var((size_t)m*w);
+    for(int a=0; a<m; a++){
+        const PathBlock& block = blocks[a];
+        double sig0 = stocks[a].getVolatility();
+        for(int j=0; j<w; j++){
+            block.data[j*block.pathStride] = stocks[a].getCurrentPrice();
+            Var[a*w+j] = sig0*sig0;
+        }
+    }
+    for(int i=1; i<n; i++){
+        for(auto& z:Z) z = sign*normal(gen);
+        for(int a=0; a<m; a++){
+            double *Xa = &X[a*w];
+            for(int j=0; j<w; j++) Xa[j] = 0;
+            for(int b=0; b<=a; b++){
+                double l = L[a*m+b];
+                const double *Zb = &Z[b*w];
+                for(int j=0; j<w; j++) Xa[j] += l*Zb[j];
+            }
+        }
+        for(int a=0; a<m; a++){
+            const PathBlock& block = blocks[a];
+            double *S0 = block.data+(size_t)(i-1)*block.stepStride, *S1 = block.data+(size_t)i*block.stepStride;
+            int ps = block.pathStride;
+            double driftRate = stocks[a].getDriftRate(), volatility = stocks[a].getVolatility();
+            const double *Xa = &X[a*w];
+            const vector<double>& dynParams = dynParamsSet[a];
+            if(model[a]==0){
+                double mult0 = 1+driftRate*dt, mult1 = volatility*sqrt_dt;
+                for(int j=0; j<w; j++) S1[j*ps] = S0[j*ps]*(mult0+mult1*Xa[j]);
+            }else if(model[a]==1){
+                double lamJ = dynParams[0];
+                double muJ  = dynParams[1];
+                double sigJ = dynParams[2];
+                poisson_distribution<int> poisson(lamJ*dt);
+                for(int j=0; j<w; j++){
+                    int k = poisson(gen);
+                    double jump = k?k*muJ*dt+sqrt((double)k)*sigJ*sqrt_dt*sign*normal(gen):0;
+                    S1[j*ps] = S0[j*ps]*(1+driftRate*dt+volatility*sqrt_dt*Xa[j]+jump);
+                }
+            }else{
+                double reversionRate    = dynParams[0];
+                double longRunVar       = dynParams[1];
+                double volOfVol         = dynParams[2];
+                double brownianCor0     = dynParams[3];
+                double brownianCor1     = sqrt(1-brownianCor0*brownianCor0);
+                double *Va = &Var[a*w];
+                for(int j=0; j<w; j++){
+                    double volRandom = brownianCor0*Xa[j]+brownianCor1*sign*normal(gen);
+                    Va[j] = max(Va[j]+reversionRate*(longRunVar-Va[j])*dt+volOfVol*sqrt(Va[j])*sqrt_dt*volRandom,0.);
+                    S1[j*ps] = S0[j*ps]*(1+driftRate*dt+sqrt(Va[j])*sqrt_dt*Xa[j]);
+                }
+            }
+        }
+    }
+    return true;
+}
+
 #endif
@@ -15,32 +15,38 @@
 
 #include <stdio.h>
 
+#define MULTI_STOCK_CHUNK 64
 
 class Market{
 private:
     double riskFreeRate;
-    Stock stock;
-    vector<Stock> stocks;
-    matrix corMatrix;
+    // immutable snapshots shared between copies, mutators swap in a new one (copy-on-write)
+    shared_ptr<const Stock> stockPtr;
+    shared_ptr<const vector<Stock>> stocksPtr;
+    shared_ptr<const matrix> corMatrixPtr, corFactorPtr;
 public:
     /**** constructors ****/
-    Market(){};
+    Market();
     Market(double riskFreeRate, const Stock& stock, const vector<Stock>& stocks={}, const matrix& corMatrix=NULL_MATRIX);
     Market(const Market& market);
     /**** accessors ****/
     double getRiskFreeRate() const {return riskFreeRate;}
-    Stock getStock(int i=-1) const {return i<0?stock:stocks[i];}
-    vector<Stock> getStocks() const {return stocks;}
-    matrix getCorMatrix() const {return corMatrix;}
+    const Stock& getStock(int i=-1) const {return i<0?*stockPtr:(*stocksPtr)[i];}
+    const vector<Stock>& getStocks() const {return *stocksPtr;}
+    const matrix& getCorMatrix() const {return *corMatrixPtr;}
+    const matrix& getCorFactor() const {return *corFactorPtr;}
     string getAsJson() const;
     /**** mutators ****/
     double setRiskFreeRate(double riskFreeRate);
     Stock setStock(const Stock& stock, int i=-1);
+    Stock& editStock(int i=-1);
     vector<Stock> setStocks(const vector<Stock>& stocks);
     matrix setCorMatrix(const matrix& corMatrix);
     /**** main ****/
     vector<matrix> simulateCorrelatedPrices(const SimulationConfig& config, int numSim=1, const vector<matrix>& randomMatrixSet={});
     vector<vector<matrix>> simulateCorrelatedPricesWithFullCalc(const SimulationConfig& config, int numSim=1, const vector<matrix>& randomMatrixSet={});
+    vector<PathBuffer> simulateCorrelatedPricePaths(const SimulationConfig& config, int numSim=1);
+    bool simulateCorrelatedBlock(const SimulationConfig& config, const vector<PathBlock>& blocks, mt19937_64& gen, double sign=1) const;
     /**** operators ****/
     friend ostream& operator<<(ostream& out, const Market& market);
 };
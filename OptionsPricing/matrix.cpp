@@ -48,21 +48,21 @@ public:
     void printToCsvFile(string file, string header="") const;
     void printToJsonFile(string file) const;
     /**** mutators ****/
-    matrix setZero();
-    matrix setZero(int rows, int cols);
-    matrix setOne();
-    matrix setOne(int rows, int cols);
-    matrix setIdentity();
-    matrix setIdentity(int rows);
-    matrix setUniformRand(double min=0, double max=1);
-    matrix setNormalRand(double mu=0, double sig=1);
-    matrix setPoissonRand(double lambda=1);
-    matrix setRow(int row, const matrix& vec);
-    matrix setCol(int col, const matrix& vec);
-    matrix setEntry(int row, int col, double a);
-    matrix setSubmatrix(int row0, int row1, int col0, int col1, const matrix& M);
-    matrix setDiags(const vector<double>& vec, const vector<int>& diags);
-    matrix setRange(double x0, double x1, int n=-1, bool inc=false);
+    matrix& setZero();
+    matrix& setZero(int rows, int cols);
+    matrix& setOne();
+    matrix& setOne(int rows, int cols);
+    matrix& setIdentity();
+    matrix& setIdentity(int rows);
+    matrix& setUniformRand(double min=0, double max=1);
+    matrix& setNormalRand(double mu=0, double sig=1);
+    matrix& setPoissonRand(double lambda=1);
+    matrix& setRow(int row, const matrix& vec);
+    matrix& setCol(int col, const matrix& vec);
+    matrix& setEntry(int row, int col, double a);
+    matrix& setSubmatrix(int row0, int row1, int col0, int col1, const matrix& M);
+    matrix& setDiags(const vector<double>& vec, const vector<int>& diags);
+    matrix& setRange(double x0, double x1, int n=-1, bool inc=false);
     /**** matrix operations ****/
     double trace() const;
     double getMax() const;
@@ -419,78 +419,78 @@ void matrix::printToJsonFile(string file) const {
 
 /**** mutators ****/
 
-matrix matrix::setZero(){
+matrix& matrix::setZero(){
     *this = matrix(rows,cols);
     return *this;
 }
 
-matrix matrix::setZero(int rows, int cols){
+matrix& matrix::setZero(int rows, int cols){
     this->rows = rows;
     this->cols = cols;
     *this = matrix(rows,cols);
     return *this;
 }
 
-matrix matrix::setOne(){
+matrix& matrix::setOne(){
     *this = matrix(rows,cols)+1;
     return *this;
 }
 
-matrix matrix::setOne(int rows, int cols){
+matrix& matrix::setOne(int rows, int cols){
     this->rows = rows;
     this->cols = cols;
     *this = matrix(rows,cols).setOne();
     return *this;
 }
 
-matrix matrix::setIdentity(){
+matrix& matrix::setIdentity(){
     assert(rows==cols);
     setZero();
     for(int row=0; row<rows; row++) m[row][row] = 1;
     return *this;
 }
 
-matrix matrix::setIdentity(int rows){
+matrix& matrix::setIdentity(int rows){
     this->rows = rows;
     this->cols = rows;
     *this = matrix(rows,rows).setIdentity();
     return *this;
 }
 
-matrix matrix::setUniformRand(double min, double max){
+matrix& matrix::setUniformRand(double min, double max){
     for(int row=0; row<rows; row++)
         for(int col=0; col<cols; col++)
             m[row][col] = uniformRand(min,max);
     return *this;
 }
 
-matrix matrix::setNormalRand(double mu, double sig){
+matrix& matrix::setNormalRand(double mu, double sig){
     for(int row=0; row<rows; row++)
         for(int col=0; col<cols; col++)
             m[row][col] = normalRand_(mu,sig);
     return *this;
 }
 
-matrix matrix::setPoissonRand(double lambda){
+matrix& matrix::setPoissonRand(double lambda){
     for(int row=0; row<rows; row++)
         for(int col=0; col<cols; col++)
             m[row][col] = poissonRand(lambda);
     return *this;
 }
 
-matrix matrix::setRow(int row, const matrix& vec){
+matrix& matrix::setRow(int row, const matrix& vec){
     assert(vec.rows==1 && cols==vec.cols);
     m[row] = vec.m[0];
     return *this;
 }
 
-matrix matrix::setCol(int col, const matrix& vec){
+matrix& matrix::setCol(int col, const matrix& vec){
     assert(vec.rows==1 && rows==vec.cols);
     for(int row=0; row<vec.cols; row++) m[row][col] = vec.m[0][row];
     return *this;
 }
 
-matrix matrix::setSubmatrix(int row0, int row1, int col0, int col1, const matrix& M){
+matrix& matrix::setSubmatrix(int row0, int row1, int col0, int col1, const matrix& M){
     if(row1<0) row1 += rows+1;
     if(col1<0) col1 += cols+1;
     for(int row=row0; row<row1; row++)
@@ -499,14 +499,14 @@ matrix matrix::setSubmatrix(int row0, int row1, int col0, int col1, const matrix
     return *this;
 }
 
-matrix matrix::setEntry(int row, int col, double a){
+matrix& matrix::setEntry(int row, int col, double a){
     assert(row>=0 && row<rows);
     assert(col>=0 && col<cols);
     m[row][col] = a;
     return *this;
 }
 
-matrix matrix::setDiags(const vector<double>& vec, const vector<int>& diags){
+matrix& matrix::setDiags(const vector<double>& vec, const vector<int>& diags){
     assert(rows==cols);
     assert(vec.size()==diags.size());
     for(int row=0; row<rows; row++)
@@ -518,7 +518,7 @@ matrix matrix::setDiags(const vector<double>& vec, const vector<int>& diags){
     return *this;
 }
 
-matrix matrix::setRange(double x0, double x1, int n, bool inc){
+matrix& matrix::setRange(double x0, double x1, int n, bool inc){
     if(n<0) n = x1-x0;
     double dx = (x1-x0)/n;
     if(inc) n += 1;
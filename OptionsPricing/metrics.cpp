@@ -0,0 +1,259 @@
+//
+//  metrics.cpp
+//  OptionsPricing
+//
+
+// timing of pricing engines and their phases: per-span call counts and latency histograms, throughput
+// counters, and a trace in the Chrome trace-event format; METRICS false compiles every span out
+#ifndef METRICS_LIB
+#define METRICS_LIB
+#include "util.cpp"
+#include <chrono>
+#include <mutex>
+#include <map>
+
+using namespace std;
+
+#ifndef METRICS
+#define METRICS true
+#endif
+
+#define METRICS_MAX_EVENTS (1<<20) // trace events kept, later ones are counted but not traced
+#define METRICS_NUM_BUCKETS 48     // latency buckets of powers of 2 in ns, the last one open
+
+struct SpanStats{
+    // duration of every span of one name
+    long count = 0;
+    long long totalNs = 0, minNs = 0, maxNs = 0;
+    long buckets[METRICS_NUM_BUCKETS] = {}; // bucket k: [2^k,2^(k+1)) ns
+    SpanStats& operator+=(const SpanStats& s){
+        if(s.count==0) return *this;
+        minNs = (count==0)?s.minNs:min(minNs,s.minNs);
+        maxNs = max(maxNs,s.maxNs);
+        count += s.count;
+        totalNs += s.totalNs;
+        for(int k=0; k<METRICS_NUM_BUCKETS; k++) buckets[k] += s.buckets[k];
+        return *this;
+    }
+};
+
+struct CounterStats{
+    // items processed inside spans, over the time of those spans
+    double items = 0;
+    long long totalNs = 0;
+    CounterStats& operator+=(const CounterStats& c){items += c.items; totalNs += c.totalNs; return *this;}
+};
+
+struct TraceEvent{
+    const char *name;
+    long long startNs, durNs;
+    int thread;
+};
+
+class Metrics{
+    // one mutex guards everything, spans only record when they close, so that the lock is taken once
+    // per engine call or phase, never per path or per node; names are string literals kept by address
+    // and merged by text when read
+private:
+    atomic<bool> enabled, tracing;
+    chrono::steady_clock::time_point origin;
+    mutable mutex lock;
+    map<const char*,SpanStats> spans;
+    map<const char*,CounterStats> counters;
+    vector<TraceEvent> events;
+    long droppedEvents = 0;
+    /**** helpers ****/
+    template <class Stats>
+    static map<string,Stats> _merged(const map<const char*,Stats>& stats){
+        map<string,Stats> merged;
+        for(auto& s:stats) merged[s.first] += s.second;
+        return merged;
+    }
+public:
+    /**** constructors ****/
+    Metrics(bool enabled=false, bool tracing=false);
+    static Metrics& global(); // OPTIONS_PRICING_METRICS=on enables the statistics, =trace the trace as well
+    /**** accessors ****/
+    bool isEnabled() const {return enabled.load(memory_order_relaxed);}
+    bool isTracing() const {return tracing.load(memory_order_relaxed);}
+    long long now() const {return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-origin).count();}
+    SpanStats getSpanStats(string name) const;
+    CounterStats getCounterStats(string name) const;
+    string getAsJson() const;
+    string getTraceAsJson() const;
+    /**** mutators ****/
+    bool setEnabled(bool enabled){return this->enabled = enabled;}
+    bool setTracing(bool tracing){if(tracing) enabled = true; return this->tracing = tracing;}
+    void clear();
+    /**** main ****/
+    void record(const char *name, long long startNs, long long durNs, const char *counter=NULL, double items=0);
+    void add(const char *counter, double items); // items outside any span, no time
+    void saveAsJson(string file) const;
+    void saveTrace(string file) const; // load in chrome://tracing or Perfetto
+};
+
+class TraceSpan{
+    // times the scope it lives in; items, given up front or added while it runs, go to the counter when
+    // it closes
+private:
+    const char *name, *counter;
+    double items;
+    long long start;
+    bool active;
+public:
+    TraceSpan(const char *name, const char *counter=NULL, double items=0):name(name),counter(counter),items(items),
+    active(Metrics::global().isEnabled()){
+        if(active) start = Metrics::global().now();
+    }
+    ~TraceSpan(){
+        if(!active) return;
+        Metrics& metrics = Metrics::global();
+        metrics.record(name,start,metrics.now()-start,counter,items);
+    }
+    void addItems(double items){this->items += items;}
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#define _METRICS_CAT(a,b) a##b
+#define _METRICS_VAR(line) _METRICS_CAT(_traceSpan,line)
+#if METRICS
+#define TRACE_SPAN(name) TraceSpan _METRICS_VAR(__LINE__)(name)
+#define TRACE_SPAN_ITEMS(name,counter,items) TraceSpan _METRICS_VAR(__LINE__)(name,counter,items)
+#define TRACE_SPAN_COUNTER(span,name,counter) TraceSpan span(name,counter) // items added by TRACE_ADD_ITEMS
+#define TRACE_ADD_ITEMS(span,items) span.addItems(items)
+#define METRIC_ADD(counter,items) do{if(Metrics::global().isEnabled()) Metrics::global().add(counter,items);}while(0)
+#else
+#define TRACE_SPAN(name)
+#define TRACE_SPAN_ITEMS(name,counter,items)
+#define TRACE_SPAN_COUNTER(span,name,counter)
+#define TRACE_ADD_ITEMS(span,items)
+#define METRIC_ADD(counter,items)
+#endif
+
+Metrics::Metrics(bool enabled, bool tracing):enabled(enabled||tracing),tracing(tracing),origin(chrono::steady_clock::now()){}
+
+Metrics& Metrics::global(){
+    // the environment is read once, on the first call, every span after that only checks the guard
+    static const string mode = getenv("OPTIONS_PRICING_METRICS")?getenv("OPTIONS_PRICING_METRICS"):"";
+    static Metrics metrics(mode=="on" || mode=="trace",mode=="trace");
+    return metrics;
+}
+
+SpanStats Metrics::getSpanStats(string name) const {
+    lock_guard<mutex> guard(lock);
+    return _merged(spans)[name];
+}
+
+CounterStats Metrics::getCounterStats(string name) const {
+    lock_guard<mutex> guard(lock);
+    return _merged(counters)[name];
+}
+
+void Metrics::clear(){
+    lock_guard<mutex> guard(lock);
+    spans.clear();
+    counters.clear();
+    events.clear();
+    droppedEvents = 0;
+}
+
+void Metrics::record(const char *name, long long startNs, long long durNs, const char *counter, double items){
+    static atomic<int> nextThread(0);
+    static thread_local int thread = nextThread++;
+    int k = 0;
+    while(k<METRICS_NUM_BUCKETS-1 && (durNs>>(k+1))>0) k++;
+    lock_guard<mutex> guard(lock);
+    SpanStats& s = spans[name];
+    if(s.count==0 || durNs<s.minNs) s.minNs = durNs;
+    if(durNs>s.maxNs) s.maxNs = durNs;
+    s.count++;
+    s.totalNs += durNs;
+    s.buckets[k]++;
+    if(counter){
+        CounterStats& c = counters[counter];
+        c.items += items;
+        c.totalNs += durNs;
+    }
+    if(tracing){
+        if(events.size()<METRICS_MAX_EVENTS) events.push_back({name,startNs,durNs,thread});
+        else droppedEvents++;
+    }
+}
+
+void Metrics::add(const char *counter, double items){
+    lock_guard<mutex> guard(lock);
+    counters[counter].items += items;
+}
+
+string Metrics::getAsJson() const {
+    // per span: count, total/mean/min/max in us and the non-empty buckets as [upper bound in us, count];
+    // per counter: items, seconds inside the spans that carried them, and items per second
+    lock_guard<mutex> guard(lock);
+    map<string,SpanStats> spans = _merged(this->spans);
+    map<string,CounterStats> counters = _merged(this->counters);
+    ostringstream oss;
+    oss << "{\"spans\":{";
+    for(auto it=spans.begin(); it!=spans.end(); it++){
+        const SpanStats& s = it->second;
+        oss << ((it==spans.begin())?"":",") << "\"" << it->first << "\":{" <<
+        "\"count\":"   << s.count                 << "," <<
+        "\"totalUs\":" << s.totalNs/1e3           << "," <<
+        "\"meanUs\":"  << s.totalNs/1e3/s.count   << "," <<
+        "\"minUs\":"   << s.minNs/1e3             << "," <<
+        "\"maxUs\":"   << s.maxNs/1e3             << "," <<
+        "\"histogram\":[";
+        bool first = true;
+        for(int k=0; k<METRICS_NUM_BUCKETS; k++){
+            if(s.buckets[k]==0) continue;
+            oss << (first?"":",") << "[" << (1LL<<(k+1))/1e3 << "," << s.buckets[k] << "]";
+            first = false;
+        }
+        oss << "]}";
+    }
+    oss << "},\"counters\":{";
+    for(auto it=counters.begin(); it!=counters.end(); it++){
+        const CounterStats& c = it->second;
+        oss << ((it==counters.begin())?"":",") << "\"" << it->first << "\":{" <<
+        "\"items\":"   << c.items         << "," <<
+        "\"seconds\":" << c.totalNs/1e9   << "," <<
+        "\"perSec\":"  << ((c.totalNs>0)?c.items/(c.totalNs/1e9):0) <<
+        "}";
+    }
+    oss << "},\"droppedEvents\":" << droppedEvents << "}";
+    return oss.str();
+}
+
+string Metrics::getTraceAsJson() const {
+    // complete events ("ph":"X") with microsecond timestamps
+    lock_guard<mutex> guard(lock);
+    ostringstream oss;
+    oss << fixed << setprecision(3);
+    oss << "{\"traceEvents\":[";
+    for(size_t k=0; k<events.size(); k++){
+        const TraceEvent& e = events[k];
+        oss << ((k==0)?"":",\n") << "{" <<
+        "\"name\":\"" << e.name         << "\"," <<
+        "\"cat\":\"pricing\"," <<
+        "\"ph\":\"X\"," <<
+        "\"ts\":"     << e.startNs/1e3  << "," <<
+        "\"dur\":"    << e.durNs/1e3    << "," <<
+        "\"pid\":1," <<
+        "\"tid\":"    << e.thread       <<
+        "}";
+    }
+    oss << "],\"displayTimeUnit\":\"ms\"}";
+    return oss.str();
+}
+
+void Metrics::saveAsJson(string file) const {
+    ofstream f(file);
+    f << getAsJson() << endl;
+}
+
+void Metrics::saveTrace(string file) const {
+    ofstream f(file);
+    f << getTraceAsJson() << endl;
+}
+
+#endif
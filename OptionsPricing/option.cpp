@@ -19,6 +19,7 @@ using namespace std;
 
 #define GUI true
 #define LOG true
+#define METRICS true // spans and counters of metrics.cpp
 #define INF 1e3
 #define USE_LOOP true
 
@@ -46,6 +47,10 @@ const set<string> EARLY_EXERCISE_OPTION_TYPES{
     "American", "Bermudan"
 };
 
+const set<string> MULTI_STOCK_OPTION_TYPES{
+    "Margrabe", "Basket", "Rainbow"
+};
+
 const set<string> PATH_DEPENDENT_OPTION_TYPES{
     "Asian",    // Asian options have a payoff based on the average price of the underlying asset over a certain period
     "Barrier",  // Barrier options become active or inactive based on the underlying asset reaching a certain price level
@@ -70,6 +75,7 @@ Option::Option(string type, string putCall, double strike, double maturity, cons
     this->params = params;
     this->nature = nature;
     this->name = name;
+    parseEnums();
     assert(checkParams());
 }
 
@@ -81,12 +87,20 @@ Option::Option(const Option& option){
     this->params = option.params;
     this->nature = option.nature;
     this->name = option.name;
+    this->typeId = option.typeId;
+    this->putCallId = option.putCallId;
+    this->natureId = option.natureId;
+    this->floatStrike = option.floatStrike;
 }
 
 bool Option::canEarlyExercise() const {
     return EARLY_EXERCISE_OPTION_TYPES.find(type)!=EARLY_EXERCISE_OPTION_TYPES.end();
 }
 
+bool Option::isMultiStock() const {
+    return MULTI_STOCK_OPTION_TYPES.find(type)!=MULTI_STOCK_OPTION_TYPES.end();
+}
+
 bool Option::isPathDependent() const {
     return PATH_DEPENDENT_OPTION_TYPES.find(type)!=PATH_DEPENDENT_OPTION_TYPES.end();
     return PATH_DEPENDENT_OPTION_TYPES.find(type)!=PATH_DEPENDENT_OPTION_TYPES.end();
@@ -113,6 +127,7 @@ string Option::setName(string name){
 
 string Option::setType(string type){
     this->type = type;
+    parseEnums();
     return type;
 }
 
@@ -138,6 +153,7 @@ vector<double> Option::setParams(const vector<double>& params){
 
 vector<string> Option::setNature(const vector<string>& nature){
     this->nature = nature;
+    parseEnums();
     return nature;
 }
 
@@ -148,174 +164,338 @@ bool Option::checkParams() const {
     strike>=0 && maturity>=0;
 }
 
+void Option::parseEnums(){
+    typeId = parseType(type);
+    putCallId = parsePutCall(putCall);
+    natureId = nature.size()>0?parseNature(nature[0]):NATURE_NONE;
+    floatStrike = nature.size()>1 && nature[1]=="Float";
+}
+
+OptionType Option::parseType(string type){
+    static const map<string,OptionType> types{
+        {"European",EUROPEAN}, {"Digital",DIGITAL}, {"American",AMERICAN}, {"Bermudan",BERMUDAN},
+        {"Asian",ASIAN}, {"Barrier",BARRIER}, {"Lookback",LOOKBACK}, {"Margrabe",MARGRABE},
+        {"Basket",BASKET}, {"Rainbow",RAINBOW}, {"Chooser",CHOOSER}, {"Shout",SHOUT}
+    };
+    auto it = types.find(type);
+    return it==types.end()?UNKNOWN_TYPE:it->second;
+}
+
+PutCall Option::parsePutCall(string putCall){
+    if(putCall=="Put") return PUT;
+    else if(putCall=="Call") return CALL;
+    return NO_PUT_CALL;
+}
+
+OptionNature Option::parseNature(string nature){
+    static const map<string,OptionNature> natures{
+        {"Arithmetic",ARITHMETIC}, {"Geometric",GEOMETRIC}, {"Double",DOUBLE_STRIKE},
+        {"Up-and-In",UP_AND_IN}, {"Up-and-Out",UP_AND_OUT}, {"Down-and-In",DOWN_AND_IN}, {"Down-and-Out",DOWN_AND_OUT},
+        {"Best",RAINBOW_BEST}, {"Max",RAINBOW_MAX}, {"Min",RAINBOW_MIN}
+    };
+    auto it = natures.find(nature);
+    return it==natures.end()?NATURE_NONE:it->second;
+}
+
 double Option::calcPayoff(double stockPrice, const matrix& priceSeries, const vector<matrix>& priceSeriesSet, const matrix& timeVector){
     // case by case
     double S;
-    if(type=="European" || type=="American"){
-        if(priceSeries.isEmpty()) S = stockPrice;
-        else S = priceSeries.getLastEntry();
-        if(putCall=="Put") return max(strike-S,0.);
-        else if(putCall=="Call") return max(S-strike,0.);
-    }else if(type=="Digital"){
-        if(priceSeries.isEmpty()) S = stockPrice;
-        else S = priceSeries.getLastEntry();
-        if(nature.size()>0){
-            string strikeType = nature[0];
-            if(strikeType=="Double"){
+    if(putCallId==NO_PUT_CALL && typeId!=CHOOSER && !(typeId==RAINBOW && natureId==RAINBOW_BEST)) return NAN;
+    bool isPut = putCallId==PUT;
+    switch(typeId){
+        case EUROPEAN: case AMERICAN:
+            S = priceSeries.isEmpty()?stockPrice:priceSeries.getLastEntry();
+            return max(isPut?strike-S:S-strike,0.);
+        case DIGITAL:
+            S = priceSeries.isEmpty()?stockPrice:priceSeries.getLastEntry();
+            if(natureId==DOUBLE_STRIKE){
                 double strike0 = params[0];
                 double strike1 = params[1];
-                if(putCall=="Put") return (S<strike0||S>strike1);
-                else if(putCall=="Call") return (S>strike0&&S<strike1);
+                return isPut?(S<strike0||S>strike1):(S>strike0&&S<strike1);
             }
-        }
-        if(putCall=="Put") return (S<strike);
-        else if(putCall=="Call") return (S>strike);
-    }else if(type=="Asian"){
-        string avgType = nature[0];
-        if(priceSeries.isEmpty()) return NAN;
-        else S = priceSeries.getRow(0).mean(avgType);
-        if(nature.size()>1){
-            string strikeType = nature[1];
-            if(strikeType=="Float"){
+            return isPut?(S<strike):(S>strike);
+        case ASIAN:{
+            if(priceSeries.isEmpty()) return NAN;
+            S = priceSeries.getRow(0).mean(nature[0]);
+            if(floatStrike){
                 double fltStrk = S;
                 S = priceSeries.getLastEntry();
-                if(putCall=="Put") return max(fltStrk-S,0.);
-                else if(putCall=="Call") return max(S-fltStrk,0.);
+                return max(isPut?fltStrk-S:S-fltStrk,0.);
             }
+            return max(isPut?strike-S:S-strike,0.);
         }
-        if(putCall=="Put") return max(strike-S,0.);
-        else if(putCall=="Call") return max(S-strike,0.);
-    }else if(type=="Barrier"){
-        if(priceSeries.isEmpty()) return NAN;
-        else S = priceSeries.getLastEntry();
-        string barrierType = nature[0];
-        double barrier = params[0];
-        double rebate = params[1];
-        bool triggered =
-        (barrierType=="Up-and-In" && max(priceSeries)>barrier) ||
-        (barrierType=="Up-and-Out" && max(priceSeries)<barrier) ||
-        (barrierType=="Down-and-In" && min(priceSeries)<barrier) ||
-        (barrierType=="Down-and-Out" && min(priceSeries)>barrier);
-        if(triggered){
-            if(putCall=="Put") return max(strike-S,0.);
-            else if(putCall=="Call") return max(S-strike,0.);
-        }else return rebate;
-    }else if(type=="Lookback"){
-        if(priceSeries.isEmpty()) return NAN;
-        else S = priceSeries.getLastEntry();
-        if(putCall=="Put"){
-            double Smax = max(priceSeries);
-            return max(Smax-S,0.);
-        }else if(putCall=="Call"){
-            double Smin = min(priceSeries);
-            return max(S-Smin,0.);
+        case BARRIER:{
+            if(priceSeries.isEmpty()) return NAN;
+            S = priceSeries.getLastEntry();
+            double barrier = params[0];
+            double rebate = params[1];
+            bool triggered =
+            (natureId==UP_AND_IN && max(priceSeries)>barrier) ||
+            (natureId==UP_AND_OUT && max(priceSeries)<barrier) ||
+            (natureId==DOWN_AND_IN && min(priceSeries)<barrier) ||
+            (natureId==DOWN_AND_OUT && min(priceSeries)>barrier);
+            if(triggered) return max(isPut?strike-S:S-strike,0.);
+            return rebate;
+        }
+        case LOOKBACK:
+            if(priceSeries.isEmpty()) return NAN;
+            S = priceSeries.getLastEntry();
+            return isPut?max(max(priceSeries)-S,0.):max(S-min(priceSeries),0.);
+        case MARGRABE:{
+            if(priceSeriesSet.empty()) return NAN;
+            double S0 = priceSeriesSet[0].getLastEntry();
+            double S1 = priceSeriesSet[1].getLastEntry();
+            return max(isPut?S1-S0:S0-S1,0.);
+        }
+        case BASKET:{
+            if(priceSeriesSet.empty()) return NAN;
+            int n = (int)priceSeriesSet.size();
+            matrix Sset(1,n);
+            for(int i=0; i<n; i++) Sset.setEntry(0,i,priceSeriesSet[i].getLastEntry());
+            string avgType = (natureId==GEOMETRIC)?"Geometric":"Arithmetic";
+            if(params.size()) S = Sset.wmean(params,avgType); // weighted average
+            else S = Sset.mean(avgType); // simple average
+            return max(isPut?strike-S:S-strike,0.);
+        }
+        case RAINBOW:{
+            if(priceSeriesSet.empty()) return NAN;
+            int n = (int)priceSeriesSet.size();
+            matrix Sset(1,n);
+            for(int i=0; i<n; i++) Sset.setEntry(0,i,priceSeriesSet[i].getLastEntry());
+            if(natureId==RAINBOW_BEST) return max(max(Sset),strike); // Best of assets or cash
+            else if(natureId==RAINBOW_MAX) S = max(Sset); // Put/Call on max
+            else if(natureId==RAINBOW_MIN) S = min(Sset); // Put/Call on min
+            else return NAN;
+            return max(isPut?strike-S:S-strike,0.);
+        }
+        case CHOOSER:{
+            if(priceSeries.isEmpty()) return NAN;
+            S = priceSeries.getLastEntry();
+            double chTime = params[0];
+            vector<int> chTimeIdx = timeVector.find(chTime,"closest");
+            bool chPut = priceSeries.getEntry(chTimeIdx)<discStrike;
+            return max(chPut?strike-S:S-strike,0.);
         }
-    }else if(type=="Margrabe"){
-        if(priceSeriesSet.empty()) return NAN;
-        double S0 = priceSeriesSet[0].getLastEntry();
-        double S1 = priceSeriesSet[1].getLastEntry();
-        if(putCall=="Put") return max(S1-S0,0.);
-        else if(putCall=="Call") return max(S0-S1,0.);
-    }else if(type=="Basket"){
-        if(priceSeriesSet.empty()) return NAN;
-        int n = (int)priceSeriesSet.size();
-        matrix Sset(1,n);
-        for(int i=0; i<n; i++) Sset.setEntry(0,i,priceSeriesSet[i].getLastEntry());
-        double S;
-        if(params.size()) S = Sset.wmean(params); // weighted average
-        else S = Sset.mean(); // simple average
-        if(putCall=="Put") return max(strike-S,0.);
-        else if(putCall=="Call") return max(S-strike,0.);
-    }else if(type=="Rainbow"){
-        if(priceSeriesSet.empty()) return NAN;
-        int n = (int)priceSeriesSet.size();
-        matrix Sset(1,n);
-        for(int i=0; i<n; i++) Sset.setEntry(0,i,priceSeriesSet[i].getLastEntry());
-        double S;
-        string rainbowType = nature[0];
-        if(rainbowType=="Best"){
-            S = max(Sset);
-            return max(S,strike); // Best of assets or cash
-        }else if(rainbowType=="Max") S = max(Sset); // Put/Call on max
-        else if(rainbowType=="Min") S = min(Sset); // Put/Call on min
-        if(putCall=="Put") return max(strike-S,0.);
-        else if(putCall=="Call") return max(S-strike,0.);
-    }else if(type=="Chooser"){
-        if(priceSeries.isEmpty()) return NAN;
-        else S = priceSeries.getLastEntry();
-        double chTime = params[0];
-        vector<int> chTimeIdx = timeVector.find(chTime,"closest");
-        string chPutCall;
-        if(priceSeries.getEntry(chTimeIdx)<discStrike) chPutCall = "Put";
-        else chPutCall = "Call";
-        if(chPutCall=="Put") return max(strike-S,0.);
-        else if(chPutCall=="Call") return max(S-strike,0.);
+        default: break;
     }
     return NAN;
 }
 
 matrix Option::calcPayoffs(const matrix& stockPriceVector, const matrix& priceMatrix, const vector<matrix>& priceMatrixSet, const matrix& timeVector){
     matrix S;
-    if(type=="European" || type=="American"){
-        if(priceMatrix.isEmpty()) S = stockPriceVector;
-        else S = priceMatrix.getLastRow();
-        if(putCall=="Put") return max(strike-S,0.);
-        else if(putCall=="Call") return max(S-strike,0.);
-    }else if(type=="Digital"){
-        if(priceMatrix.isEmpty()) S = stockPriceVector;
-        else S = priceMatrix.getLastRow();
-        if(nature.size()>0){
-            string strikeType = nature[0];
-            if(strikeType=="Double"){
-                double strike0 = params[0];
-                double strike1 = params[1];
-                if(putCall=="Put") return (S<strike0)||(S>strike1);
-                else if(putCall=="Call") return (S>strike0)&&(S<strike1);
+    bool isPut = putCallId==PUT;
+    switch(typeId){
+        case EUROPEAN: case AMERICAN: case DIGITAL:{
+            if(putCallId==NO_PUT_CALL || (priceMatrix.isEmpty() && stockPriceVector.isEmpty())) return NULL_VECTOR;
+            vector<double> Svec = priceMatrix.isEmpty()?stockPriceVector.getRowVector(0):priceMatrix.getRowVector(priceMatrix.getRows()-1);
+            int n = (int)Svec.size();
+            vector<double> Vvec(n);
+            const double *S = Svec.data();
+            double *P = Vvec.data();
+            if(typeId==DIGITAL && natureId==DOUBLE_STRIKE){
+                if(isPut) applyPayoff(DoubleDigitalPayoff<PUT>{params[0],params[1]},S,P,n);
+                else applyPayoff(DoubleDigitalPayoff<CALL>{params[0],params[1]},S,P,n);
+            }else if(typeId==DIGITAL){
+                if(isPut) applyPayoff(DigitalPayoff<PUT>{strike},S,P,n);
+                else applyPayoff(DigitalPayoff<CALL>{strike},S,P,n);
+            }else{
+                if(isPut) applyPayoff(VanillaPayoff<PUT>{strike},S,P,n);
+                else applyPayoff(VanillaPayoff<CALL>{strike},S,P,n);
             }
+            return matrix(Vvec);
         }
-        if(putCall=="Put") return (S<strike);
-        else if(putCall=="Call") return (S>strike);
-    }else if(type=="Asian"){
-        string avgType = nature[0];
-        if(priceMatrix.isEmpty()) return NULL_VECTOR;
-        else S = priceMatrix.mean(2,avgType);
-        if(nature.size()>1){
-            string strikeType = nature[1];
-            if(strikeType=="Float"){
+        case ASIAN:
+            if(priceMatrix.isEmpty() || putCallId==NO_PUT_CALL) return NULL_VECTOR;
+            S = priceMatrix.mean(2,nature[0]);
+            if(floatStrike){
                 matrix fltStrk = S;
                 S = priceMatrix.getLastRow();
-                if(putCall=="Put") return max(fltStrk-S,0.);
-                else if(putCall=="Call") return max(S-fltStrk,0.);
+                return isPut?max(fltStrk-S,0.):max(S-fltStrk,0.);
             }
+            return isPut?max(strike-S,0.):max(S-strike,0.);
+        case BARRIER: case LOOKBACK: case CHOOSER:{ // generic single-stock, on the path kernel
+            if(priceMatrix.isEmpty() && typeId!=BARRIER) return NULL_VECTOR;
+            PathBuffer paths(priceMatrix.isEmpty()?stockPriceVector:priceMatrix);
+            return calcPayoffs(paths,timeVector);
         }
-        if(putCall=="Put") return max(strike-S,0.);
-        else if(putCall=="Call") return max(S-strike,0.);
-    }else if(type=="Barrier" || type=="Lookback" || type=="Chooser"){ // generic single-stock
-        matrix _priceMatrix = priceMatrix;
-        if(priceMatrix.isEmpty()){
-            if(type=="Barrier"){
-                _priceMatrix = stockPriceVector;
-            }else return NULL_VECTOR;
-        }
-        int n = _priceMatrix.getCols();
-        matrix V(1,n);
-        for(int i=0; i<n; i++) V.setEntry(0,i,calcPayoff(0,_priceMatrix.getCol(i),{},timeVector));
-        return V;
-    }else if(type=="Margrabe" || type=="Basket" || type=="Rainbow"){ // generic multi-stock
-        if(priceMatrixSet.empty()) return NULL_VECTOR;
-        int n = priceMatrixSet[0].getCols();
-        int m = (int)priceMatrixSet.size();
-        matrix V(1,n);
-        for(int i=0; i<n; i++){
-            vector<matrix> priceSeriesSet;
-            for(int j=0; j<m; j++) priceSeriesSet.push_back(priceMatrixSet[j].getCol(i));
-            V.setEntry(0,i,calcPayoff(0,NULL_VECTOR,priceSeriesSet));
+        case MARGRABE: case BASKET: case RAINBOW:{ // generic multi-stock
+            if(priceMatrixSet.empty()) return NULL_VECTOR;
+            vector<PathBuffer> pathsSet;
+            for(auto& priceMatrix:priceMatrixSet) pathsSet.push_back(PathBuffer(priceMatrix));
+            return calcPayoffs(pathsSet);
         }
-        return V;
+        default: break;
     }
     return NULL_VECTOR;
 }
 
+matrix Option::calcPayoffs(const PathBuffer& paths, const matrix& timeVector,
+                           string barrierCorrection, double sig){
+    vector<double> V(paths.getPaths());
+    for(int b=0; b<paths.getNumBlocks(); b++){
+        PathBlock block = paths.getBlock(b);
+        if(!calcPayoffsBlock(block,&V[block.path0],timeVector,barrierCorrection,sig)) return NULL_VECTOR;
+    }
+    return matrix(V);
+}
+
+bool Option::calcPayoffsBlock(const PathBlock& block, double *payoffs, const matrix& timeVector,
+                              string barrierCorrection, double sig){
+    // running path statistics, streamed along the contiguous dimension of the block
+    // barrierCorrection for a continuously monitored barrier, given lognormal vol sig:
+    //   "bridge": weight each path by its Brownian-bridge probability of no crossing between steps
+    //   "BGK": shift the barrier towards the spot by exp(-0.5826*sig*sqrt(dt)) (Broadie-Glasserman-Kou)
+    int n = block.steps;
+    int w = block.width;
+    int ss = block.stepStride, ps = block.pathStride;
+    const double *S = block.data;
+    bool isPut = putCallId==PUT;
+    bool needAvg = typeId==ASIAN;
+    bool geometric = needAvg && natureId==GEOMETRIC;
+    int chIdx = (typeId==CHOOSER)?timeVector.find(params[0],"closest")[1]:n-1;
+    double dt = (n>1 && timeVector.getCols()>1)?timeVector.getEntry(0,1)-timeVector.getEntry(0,0):0;
+    bool isBarrier = typeId==BARRIER;
+    bool up = isBarrier && (natureId==UP_AND_IN || natureId==UP_AND_OUT);
+    double barrier = isBarrier?params[0]:0;
+    if(isBarrier && barrierCorrection=="BGK") barrier *= exp((up?-1:1)*0.5826*sig*sqrt(dt));
+    bool bridge = isBarrier && barrierCorrection=="bridge" && sig>0 && dt>0;
+    // survival of step i-1 -> i is 1-exp(-2*log(B/S0)*log(B/S1)/(sig^2*dt)) while both sides stay inside
+    double bridgeRate = bridge?-2/(sig*sig*dt):0;
+    vector<double> Smax(w), Smin(w), Savg(w), Sch(w), ST(w), Psurv(bridge?w:0,1.), logB(bridge?w:0);
+    if(ps==1){
+        for(int j=0; j<w; j++){
+            Smax[j] = Smin[j] = S[j];
+            Savg[j] = geometric?log(S[j]):S[j];
+        }
+        if(bridge) for(int j=0; j<w; j++) logB[j] = log(barrier/S[j]);
+        for(int i=1; i<n; i++){
+            const double *row = S+i*ss;
+            for(int j=0; j<w; j++){
+                Smax[j] = max(Smax[j],row[j]);
+                Smin[j] = min(Smin[j],row[j]);
+            }
+            if(needAvg) for(int j=0; j<w; j++) Savg[j] += geometric?log(row[j]):row[j];
+            if(bridge) for(int j=0; j<w; j++){
+                double l1 = log(barrier/row[j]);
+                Psurv[j] *= 1-exp(bridgeRate*logB[j]*l1);
+                logB[j] = l1;
+            }
+        }
+        for(int j=0; j<w; j++){
+            Sch[j] = S[chIdx*ss+j];
+            ST[j] = S[(n-1)*ss+j];
+        }
+    }else{
+        for(int j=0; j<w; j++){
+            const double *path = S+j*ps;
+            double pmax = path[0], pmin = path[0], psum = geometric?log(path[0]):path[0];
+            for(int i=1; i<n; i++){
+                pmax = max(pmax,path[i]);
+                pmin = min(pmin,path[i]);
+            }
+            if(needAvg) for(int i=1; i<n; i++) psum += geometric?log(path[i]):path[i];
+            if(bridge){
+                double l0 = log(barrier/path[0]), psurv = 1;
+                for(int i=1; i<n; i++){
+                    double l1 = log(barrier/path[i]);
+                    psurv *= 1-exp(bridgeRate*l0*l1);
+                    l0 = l1;
+                }
+                Psurv[j] = psurv;
+            }
+            Smax[j] = pmax; Smin[j] = pmin; Savg[j] = psum;
+            Sch[j] = path[chIdx];
+            ST[j] = path[n-1];
+        }
+    }
+    if(needAvg) for(int j=0; j<w; j++) Savg[j] = geometric?exp(Savg[j]/n):Savg[j]/n;
+    double K = strike;
+    if(typeId==EUROPEAN || typeId==AMERICAN){
+        if(isPut) applyPayoff(VanillaPayoff<PUT>{K},&ST[0],payoffs,w);
+        else applyPayoff(VanillaPayoff<CALL>{K},&ST[0],payoffs,w);
+    }else if(typeId==DIGITAL){
+        if(natureId==DOUBLE_STRIKE){
+            if(isPut) applyPayoff(DoubleDigitalPayoff<PUT>{params[0],params[1]},&ST[0],payoffs,w);
+            else applyPayoff(DoubleDigitalPayoff<CALL>{params[0],params[1]},&ST[0],payoffs,w);
+        }else if(isPut) applyPayoff(DigitalPayoff<PUT>{K},&ST[0],payoffs,w);
+        else applyPayoff(DigitalPayoff<CALL>{K},&ST[0],payoffs,w);
+    }else if(typeId==ASIAN){
+        if(floatStrike){
+            if(isPut) applyPayoff(FloatStrikePayoff<PUT>(),&Savg[0],&ST[0],payoffs,w);
+            else applyPayoff(FloatStrikePayoff<CALL>(),&Savg[0],&ST[0],payoffs,w);
+        }else if(isPut) applyPayoff(VanillaPayoff<PUT>{K},&Savg[0],payoffs,w);
+        else applyPayoff(VanillaPayoff<CALL>{K},&Savg[0],payoffs,w);
+    }else if(typeId==BARRIER){
+        double rebate = params[1];
+        bool in = natureId==UP_AND_IN || natureId==DOWN_AND_IN;
+        for(int j=0; j<w; j++){
+            bool crossed = up?(Smax[j]>barrier):(Smin[j]<barrier);
+            bool triggered = in?crossed:(up?Smax[j]<barrier:Smin[j]>barrier);
+            double V = max(isPut?K-ST[j]:ST[j]-K,0.);
+            if(bridge && !crossed){
+                // a path that stayed inside on the grid still crosses in between with prob 1-Psurv
+                double p = in?1-Psurv[j]:Psurv[j];
+                payoffs[j] = p*V+(1-p)*rebate;
+            }else payoffs[j] = triggered?V:rebate;
+        }
+    }else if(typeId==LOOKBACK){
+        // floating strike at the running extreme
+        if(isPut) applyPayoff(FloatStrikePayoff<PUT>(),&Smax[0],&ST[0],payoffs,w);
+        else applyPayoff(FloatStrikePayoff<CALL>(),&Smin[0],&ST[0],payoffs,w);
+    }else if(typeId==CHOOSER){
+        for(int j=0; j<w; j++) payoffs[j] = max((Sch[j]<discStrike)?K-ST[j]:ST[j]-K,0.);
+    }else return false;
+    return true;
+}
+
+
+matrix Option::calcPayoffs(const vector<PathBuffer>& pathsSet){
+    // blocks of the same index cover the same paths as all buffers share one layout
+    if(pathsSet.empty()) return NULL_VECTOR;
+    vector<double> V(pathsSet[0].getPaths());
+    vector<PathBlock> blocks(pathsSet.size());
+    for(int b=0; b<pathsSet[0].getNumBlocks(); b++){
+        for(int a=0; a<(int)pathsSet.size(); a++) blocks[a] = pathsSet[a].getBlock(b);
+        if(!calcPayoffsBlock(blocks,&V[blocks[0].path0])) return NULL_VECTOR;
+    }
+    return matrix(V);
+}
+
+bool Option::calcPayoffsBlock(const vector<PathBlock>& blocks, double *payoffs){
+    // terminal multi-stock payoffs, one block per stock over the same paths
+    int m = (int)blocks.size();
+    int n = blocks[0].steps;
+    int w = blocks[0].width;
+    bool isPut = putCallId==PUT;
+    double K = strike;
+    vector<double> ST(m);
+    bool weighted = typeId==BASKET && (int)params.size()==m;
+    double weightSum = 0;
+    if(weighted) for(auto wt:params) weightSum += wt;
+    bool geometric = typeId==BASKET && natureId==GEOMETRIC;
+    OptionNature rainbowType = (typeId==RAINBOW)?natureId:NATURE_NONE;
+    if(typeId!=MARGRABE && typeId!=BASKET && typeId!=RAINBOW) return false;
+    for(int j=0; j<w; j++){
+        for(int a=0; a<m; a++) ST[a] = blocks[a].data[(size_t)(n-1)*blocks[a].stepStride+(size_t)j*blocks[a].pathStride];
+        double S = 0;
+        if(typeId==MARGRABE){
+            payoffs[j] = max(isPut?ST[1]-ST[0]:ST[0]-ST[1],0.);
+            continue;
+        }else if(typeId==BASKET){
+            for(int a=0; a<m; a++) S += (weighted?params[a]:1)*(geometric?log(ST[a]):ST[a]);
+            S /= weighted?weightSum:m;
+            if(geometric) S = exp(S);
+        }else{
+            S = (rainbowType==RAINBOW_MIN)?*min_element(ST.begin(),ST.end()):*max_element(ST.begin(),ST.end());
+            if(rainbowType==RAINBOW_BEST){
+                payoffs[j] = max(S,K);
+                continue;
+            }
+        }
+        payoffs[j] = max(isPut?K-S:S-K,0.);
+    }
+    return true;
+}
 
 
 
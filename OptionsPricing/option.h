@@ -10,13 +10,16 @@
 
 #include <iostream>
 #include <sstream>
+#include <map>
 
 #include "stock.h"
 #include "simulationConfig.hpp"
 #include "matrix.cpp"
+#include "pathBuffer.hpp"
 
 #define GUI true
 #define LOG true
+#define METRICS true // spans and counters of metrics.cpp
 #define INF 1e3
 #define USE_LOOP true
 
@@ -27,21 +30,67 @@ const SimulationConfig NULL_CONFIG;
 
 using namespace std;
 
+// string fields parsed once on construction, payoff code dispatches on these
+enum OptionType {EUROPEAN, DIGITAL, AMERICAN, BERMUDAN, ASIAN, BARRIER, LOOKBACK,
+                 MARGRABE, BASKET, RAINBOW, CHOOSER, SHOUT, UNKNOWN_TYPE};
+enum PutCall {PUT, CALL, NO_PUT_CALL};
+enum OptionNature {NATURE_NONE, ARITHMETIC, GEOMETRIC, DOUBLE_STRIKE,
+                   UP_AND_IN, UP_AND_OUT, DOWN_AND_IN, DOWN_AND_OUT,
+                   RAINBOW_BEST, RAINBOW_MAX, RAINBOW_MIN};
+
+/**** payoff kernels ****/
+// put/call is a template parameter so the loops over a path block carry no branch
+
+template<PutCall PC> struct VanillaPayoff{
+    double K;
+    double operator()(double S) const {return max(PC==CALL?S-K:K-S,0.);}
+};
+
+template<PutCall PC> struct FloatStrikePayoff{
+    double operator()(double X, double S) const {return max(PC==CALL?S-X:X-S,0.);}
+};
+
+template<PutCall PC> struct DigitalPayoff{
+    double K;
+    double operator()(double S) const {return PC==CALL?S>K:S<K;}
+};
+
+template<PutCall PC> struct DoubleDigitalPayoff{
+    double K0, K1;
+    double operator()(double S) const {return PC==CALL?(S>K0&&S<K1):(S<K0||S>K1);}
+};
+
+template<class Payoff>
+inline void applyPayoff(const Payoff& payoff, const double *S, double *V, int w){
+    for(int j=0; j<w; j++) V[j] = payoff(S[j]);
+}
+
+template<class Payoff>
+inline void applyPayoff(const Payoff& payoff, const double *X, const double *S, double *V, int w){
+    for(int j=0; j<w; j++) V[j] = payoff(X[j],S[j]);
+}
+
 class Option{
 private:
     string name, type, putCall;
     double strike, discStrike, maturity;
     vector<double> params;
     vector<string> nature;
+    OptionType typeId;
+    PutCall putCallId;
+    OptionNature natureId;
+    bool floatStrike;
+    void parseEnums();
 public:
     /**** constructors ****/
-    Option(){};
+    Option(){parseEnums();};
     Option(string type, string putCall, double strike, double maturity,
            const vector<double>& params={}, const vector<string>& nature={}, string name="unnamed");
     Option(const Option& option);
     /**** accessors ****/
     bool canEarlyExercise() const;
     bool isPathDependent() const;
+    bool isMultiStock() const;
     string getName() const {return name;}
     string getType() const {return type;}
     string getPutCall() const {return putCall;}
@@ -50,6 +99,9 @@ public:
     double getMaturity() const {return maturity;}
     vector<double> getParams() const {return params;}
     vector<string> getNature() const {return nature;}
+    OptionType getTypeId() const {return typeId;}
+    PutCall getPutCallId() const {return putCallId;}
+    OptionNature getNatureId() const {return natureId;}
     string getAsJson() const;
     /**** mutators ****/
     string setName(string name);
@@ -65,6 +117,15 @@ public:
                       const vector<matrix>& priceSeriesSet={}, const matrix& timeVector=NULL_VECTOR);
     matrix calcPayoffs(const matrix& stockPriceVector=NULL_VECTOR, const matrix& priceMatrix=NULL_MATRIX,
                        const vector<matrix>& priceMatrixSet={}, const matrix& timeVector=NULL_VECTOR);
+    matrix calcPayoffs(const PathBuffer& paths, const matrix& timeVector=NULL_VECTOR,
+                       string barrierCorrection="none", double sig=0);
+    bool calcPayoffsBlock(const PathBlock& block, double *payoffs, const matrix& timeVector=NULL_VECTOR,
+                          string barrierCorrection="none", double sig=0);
+    matrix calcPayoffs(const vector<PathBuffer>& pathsSet);
+    bool calcPayoffsBlock(const vector<PathBlock>& blocks, double *payoffs);
+    static OptionType parseType(string type);
+    static PutCall parsePutCall(string putCall);
+    static OptionNature parseNature(string nature);
     /**** operators ****/
     friend ostream& operator<<(ostream& out, const Option& option);
 };
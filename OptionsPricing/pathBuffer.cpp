@@ -0,0 +1,89 @@
+//
+//  pathBuffer.cpp
+//  OptionsPricing
+//
+
+#include "pathBuffer.hpp"
+
+#ifndef PATHBUFFER
+#define PATHBUFFER
+
+PathBuffer::PathBuffer(int steps, int paths, string layout, int tilePaths){
+    this->steps = steps;
+    this->paths = paths;
+    this->layout = parseLayout(layout);
+    this->tilePaths = (this->layout==TILED)?(tilePaths>0?tilePaths:calcTilePaths(steps)):paths;
+    this->data = vector<double>((size_t)steps*paths);
+}
+
+PathBuffer::PathBuffer(const matrix& priceMatrix, string layout, int tilePaths){
+    *this = PathBuffer(priceMatrix.getRows(),priceMatrix.getCols(),layout,tilePaths);
+    for(int i=0; i<steps; i++)
+        for(int j=0; j<paths; j++)
+            setEntry(i,j,priceMatrix.getEntry(i,j));
+}
+
+int PathBuffer::getNumBlocks() const {
+    if(layout==TILED) return (paths+tilePaths-1)/tilePaths;
+    return 1;
+}
+
+PathBlock PathBuffer::getBlock(int b) const {
+    PathBlock block;
+    double *base = const_cast<double*>(data.data());
+    switch(layout){
+        case TIME_MAJOR:
+            block = {base,steps,0,paths,paths,1}; break;
+        case PATH_MAJOR:
+            block = {base,steps,0,paths,1,steps}; break;
+        case TILED:{
+            int path0 = b*tilePaths;
+            int width = min(tilePaths,paths-path0);
+            block = {base+(size_t)path0*steps,steps,path0,width,width,1}; break;
+        }
+    }
+    return block;
+}
+
+size_t PathBuffer::index(int step, int path) const {
+    switch(layout){
+        case TIME_MAJOR: return (size_t)step*paths+path;
+        case PATH_MAJOR: return (size_t)path*steps+step;
+        case TILED:{
+            int path0 = path-path%tilePaths;
+            int width = min(tilePaths,paths-path0);
+            return (size_t)path0*steps+(size_t)step*width+(path-path0);
+        }
+    }
+    return 0;
+}
+
+matrix PathBuffer::getRow(int step) const {
+    vector<double> v(paths);
+    for(int j=0; j<paths; j++) v[j] = getEntry(step,j);
+    return matrix(v);
+}
+
+matrix PathBuffer::toMatrix() const {
+    if(layout==TIME_MAJOR) return matrix(steps,paths,const_cast<double*>(data.data()));
+    matrix M(steps,paths);
+    for(int i=0; i<steps; i++)
+        for(int j=0; j<paths; j++)
+            M.setEntry(i,j,getEntry(i,j));
+    return M;
+}
+
+PathLayout PathBuffer::parseLayout(string layout){
+    if(layout=="path-major") return PATH_MAJOR;
+    else if(layout=="tiled") return TILED;
+    return TIME_MAJOR;
+}
+
+int PathBuffer::calcTilePaths(int steps, int cacheBytes){
+    // paths per tile so that a full tile (all steps) fits in cache, multiple of 8 for vector lanes
+    int tilePaths = cacheBytes/(int)(sizeof(double)*max(steps,1));
+    tilePaths -= tilePaths%8;
+    return max(tilePaths,8);
+}
+
+#endif
@@ -0,0 +1,59 @@
+//
+//  pathBuffer.hpp
+//  OptionsPricing
+//
+
+#ifndef pathBuffer_hpp
+#define pathBuffer_hpp
+
+#include "util.cpp"
+#include "matrix.cpp"
+
+#define L2_CACHE_BYTES 262144
+
+using namespace std;
+
+enum PathLayout{
+    TIME_MAJOR, // entry (i,j) at i*paths+j, one row per time step
+    PATH_MAJOR, // entry (i,j) at j*steps+i, one row per path
+    TILED       // tiles of paths x steps, time-major within each tile
+};
+
+// contiguous view on a group of paths
+// entry (i,j) of the block sits at data[i*stepStride+j*pathStride]
+struct PathBlock{
+    double *data;
+    int steps, path0, width;
+    int stepStride, pathStride;
+};
+
+class PathBuffer{
+private:
+    int steps, paths, tilePaths;
+    PathLayout layout;
+    vector<double> data;
+public:
+    /**** constructors ****/
+    PathBuffer():steps(0),paths(0),tilePaths(0),layout(TIME_MAJOR){}
+    PathBuffer(int steps, int paths, string layout="time-major", int tilePaths=0);
+    PathBuffer(const matrix& priceMatrix, string layout="time-major", int tilePaths=0);
+    /**** accessors ****/
+    bool isEmpty() const {return data.empty();}
+    int getSteps() const {return steps;}
+    int getPaths() const {return paths;}
+    int getTilePaths() const {return tilePaths;}
+    PathLayout getLayout() const {return layout;}
+    int getNumBlocks() const;
+    PathBlock getBlock(int b) const;
+    double getEntry(int step, int path) const {return data[index(step,path)];}
+    size_t index(int step, int path) const;
+    matrix getRow(int step) const;
+    matrix toMatrix() const;
+    /**** mutators ****/
+    void setEntry(int step, int path, double a){data[index(step,path)] = a;}
+    /**** static ****/
+    static PathLayout parseLayout(string layout);
+    static int calcTilePaths(int steps, int cacheBytes=L2_CACHE_BYTES);
+};
+
+#endif /* pathBuffer_hpp */
@@ -0,0 +1,124 @@
+//
+//  priceCache.cpp
+//  OptionsPricing
+//
+
+// bounded least-recently-used cache of pricing results, shared between threads and pricer copies
+#ifndef PRICECACHE
+#define PRICECACHE
+#include "util.cpp"
+#include "matrix.cpp"
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+using namespace std;
+
+class CacheKey{
+    // exact byte image of the inputs of a calculation, doubles by their bits so that only identical inputs
+    // share an entry; the hash of the cache is taken over these bytes
+public:
+    string bytes;
+    /**** mutators ****/
+    CacheKey& add(double v){bytes.append((const char*)&v,sizeof(v)); return *this;}
+    CacheKey& add(long long v){bytes.append((const char*)&v,sizeof(v)); return *this;}
+    CacheKey& add(int v){return add((long long)v);}
+    CacheKey& add(const string& s){add((long long)s.size()); bytes += s; return *this;}
+    CacheKey& add(const vector<double>& v){add((long long)v.size()); for(double x:v) add(x); return *this;}
+    CacheKey& add(const vector<string>& v){add((long long)v.size()); for(auto& s:v) add(s); return *this;}
+    CacheKey& add(const matrix& M){
+        add(M.getRows()).add(M.getCols());
+        for(int i=0; i<M.getRows(); i++) for(int j=0; j<M.getCols(); j++) add(M.getEntry(i,j));
+        return *this;
+    }
+};
+
+class PriceCache{
+    // values by key in recency order: hits move to the front, inserts beyond capacity evict from the back;
+    // one mutex guards both, the engines run outside it so two threads may compute the same miss; a value
+    // is the result followed by whatever the engine leaves beside it (the Monte Carlo error and bounds)
+private:
+    typedef list<pair<string,vector<double>>> Entries;
+    size_t capacity;
+    Entries entries; // most recent first
+    unordered_map<string,Entries::iterator> index;
+    long hits = 0, misses = 0, evictions = 0;
+    mutable mutex lock;
+public:
+    /**** constructors ****/
+    PriceCache(size_t capacity=1<<16):capacity(capacity){}
+    /**** accessors ****/
+    size_t getCapacity() const {return capacity;}
+    size_t getSize() const {lock_guard<mutex> guard(lock); return entries.size();}
+    long getHits() const {lock_guard<mutex> guard(lock); return hits;}
+    long getMisses() const {lock_guard<mutex> guard(lock); return misses;}
+    long getEvictions() const {lock_guard<mutex> guard(lock); return evictions;}
+    double getHitRate() const {lock_guard<mutex> guard(lock); return (hits+misses>0)?(double)hits/(hits+misses):0;}
+    string getAsJson() const;
+    /**** mutators ****/
+    bool lookup(const string& key, vector<double>& value);
+    bool lookup(const string& key, double& value);
+    void insert(const string& key, const vector<double>& value);
+    void insert(const string& key, double value){insert(key,vector<double>{value});}
+    void clear();
+};
+
+string PriceCache::getAsJson() const {
+    lock_guard<mutex> guard(lock);
+    ostringstream oss;
+    oss << "{" <<
+    "\"capacity\":"   << capacity       << "," <<
+    "\"size\":"       << entries.size() << "," <<
+    "\"hits\":"       << hits           << "," <<
+    "\"misses\":"     << misses         << "," <<
+    "\"evictions\":"  << evictions      <<
+    "}";
+    return oss.str();
+}
+
+bool PriceCache::lookup(const string& key, vector<double>& value){
+    lock_guard<mutex> guard(lock);
+    auto it = index.find(key);
+    if(it==index.end()){
+        misses++;
+        return false;
+    }
+    entries.splice(entries.begin(),entries,it->second);
+    value = it->second->second;
+    hits++;
+    return true;
+}
+
+bool PriceCache::lookup(const string& key, double& value){
+    vector<double> v;
+    if(!lookup(key,v)) return false;
+    value = v[0];
+    return true;
+}
+
+void PriceCache::insert(const string& key, const vector<double>& value){
+    lock_guard<mutex> guard(lock);
+    if(capacity==0) return;
+    auto it = index.find(key);
+    if(it!=index.end()){
+        it->second->second = value;
+        entries.splice(entries.begin(),entries,it->second);
+        return;
+    }
+    entries.push_front({key,value});
+    index[key] = entries.begin();
+    if(entries.size()>capacity){
+        index.erase(entries.back().first);
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+void PriceCache::clear(){
+    lock_guard<mutex> guard(lock);
+    entries.clear();
+    index.clear();
+    hits = misses = evictions = 0;
+}
+
+#endif
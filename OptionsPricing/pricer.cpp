@@ -10,15 +10,63 @@
 
 #include <iostream>
 #include <sstream>
+#include <chrono>
 #include "pricer.hpp"
 #include "stock.h"
 #include "util.cpp"
 #include "complx.cpp"
 #include "matrix.cpp"
+#include "autodiff.cpp"
+#include "priceCache.cpp"
+#include "logger.cpp"
+#include "metrics.cpp"
 
 using namespace std;
 
-inline void logMessage(string msg){if(LOG) cout << getCurrentTime() << " [LOG] " << msg << endl;}
+inline double applyControlVariate(vector<double>& payoffs, const vector<double>& cvPayoffs, double cvMean){
+    // V -= beta*(X-E[X]) with beta = Cov(V,X)/Var(X) estimated on the same paths, return beta
+    int n = (int)payoffs.size();
+    double sV = 0, sX = 0, sXX = 0, sXV = 0;
+    for(int j=0; j<n; j++){
+        double V = payoffs[j], X = cvPayoffs[j];
+        sV += V; sX += X; sXX += X*X; sXV += X*V;
+    }
+    double varX = sXX-sX*sX/n;
+    double beta = varX>0?(sXV-sX*sV/n)/varX:0;
+    for(int j=0; j<n; j++) payoffs[j] -= beta*(cvPayoffs[j]-cvMean);
+    return beta;
+}
+
+inline void calcLsmBasis(double x, bool laguerre, int degree, double *phi){
+    // regression basis in moneyness x=S/K: 1, x, ..., x^degree or 1, exp(-x/2)L_k(x) for Laguerre L_0..L_{degree-1}
+    phi[0] = 1;
+    if(!laguerre){
+        for(int k=1; k<=degree; k++) phi[k] = phi[k-1]*x;
+        return;
+    }
+    double w = exp(-x/2), L0 = 0, L1 = 1;
+    for(int k=0; k<degree; k++){
+        phi[k+1] = w*L1;
+        double L2 = ((2*k+1-x)*L1-k*L0)/(k+1);
+        L0 = L1; L1 = L2;
+    }
+}
+
+inline vector<PathBlock> splitPathBlocks(const PathBuffer& paths, int chunk){
+    // cut every block of the buffer into pieces of at most chunk paths
+    vector<PathBlock> chunks;
+    for(int b=0; b<paths.getNumBlocks(); b++){
+        PathBlock block = paths.getBlock(b);
+        for(int k=0; k<block.width; k+=chunk){
+            PathBlock piece = block;
+            piece.data += (size_t)k*block.pathStride;
+            piece.path0 += k;
+            piece.width = min(chunk,block.width-k);
+            chunks.push_back(piece);
+        }
+    }
+    return chunks;
+}
 
 
 
@@ -38,51 +86,62 @@ string Pricer::getAsJson() const {
     return oss.str();
 }
 
+PricerVariable Pricer::parseVariable(string var){
+    static const map<string,PricerVariable> variables{
+        {"currentPrice",CURRENT_PRICE}, {"driftRate",DRIFT_RATE}, {"dividendYield",DIVIDEND_YIELD},
+        {"volatility",VOLATILITY}, {"correlation",CORRELATION}, {"riskFreeRate",RISK_FREE_RATE},
+        {"strike",STRIKE}, {"maturity",MATURITY}
+    };
+    auto it = variables.find(var);
+    return it==variables.end()?UNKNOWN_VARIABLE:it->second;
+}
+
 double Pricer::getVariable(string var, int i, int j) const {
-    double v = NAN;
-    if(var=="currentPrice"){
-        Stock stock = market.getStock(i);
-        v = stock.getCurrentPrice();
-    }else if(var=="driftRate"){
-        Stock stock = market.getStock(i);
-        v = stock.getDriftRate();
-    }else if(var=="dividendYield"){
-        Stock stock = market.getStock(i);
-        v = stock.getDividendYield();
-    }else if(var=="volatility"){
-        Stock stock = market.getStock(i);
-        v = stock.getVolatility();
-    }else if(var=="correlation"){
-        v = market.getCorMatrix().getEntry(i,j);
-    }else if(var=="riskFreeRate"){
-        v = market.getRiskFreeRate();
-    }else if(var=="strike"){
-        v = option.getStrike();
-    }else if(var=="maturity"){
-        v = option.getMaturity();
+    return getVariable(parseVariable(var),i,j);
+}
+
+double Pricer::getVariable(PricerVariable var, int i, int j) const {
+    switch(var){
+        case CURRENT_PRICE:  return market.getStock(i).getCurrentPrice();
+        case DRIFT_RATE:     return market.getStock(i).getDriftRate();
+        case DIVIDEND_YIELD: return market.getStock(i).getDividendYield();
+        case VOLATILITY:     return market.getStock(i).getVolatility();
+        case CORRELATION:    return market.getCorMatrix().getEntry(i,j);
+        case RISK_FREE_RATE: return market.getRiskFreeRate();
+        case STRIKE:         return option.getStrike();
+        case MATURITY:       return option.getMaturity();
+        default: break;
     }
-    return v;
+    return NAN;
+}
+
+PricingInputs<double> Pricer::getPricingInputs() const {
+    return {getVariable(CURRENT_PRICE),getVariable(STRIKE),getVariable(MATURITY),
+            getVariable(RISK_FREE_RATE),getVariable(DIVIDEND_YIELD),getVariable(VOLATILITY)};
 }
 
-double Pricer::setVariable(string var, double v, int i){
-    if(var=="currentPrice"){
-        Stock tmpStock = market.getStock(i);
-        tmpStock.setCurrentPrice(v);
-        market.setStock(tmpStock,i);
-    }else if(var=="dividendYield"){
-        Stock tmpStock = market.getStock(i);
-        tmpStock.setDividendYield(v);
-        market.setStock(tmpStock,i);
-    }else if(var=="volatility"){
-        Stock tmpStock = market.getStock(i);
-        tmpStock.setVolatility(v);
-        market.setStock(tmpStock,i);
-    }else if(var=="riskFreeRate"){
-        market.setRiskFreeRate(v);
-    }else if(var=="strike"){
-        option.setStrike(v);
-    }else if(var=="maturity"){
-        option.setMaturity(v);
+double Pricer::setVariable(string var, double v, int i, int j){
+    return setVariable(parseVariable(var),v,i,j);
+}
+
+double Pricer::setVariable(PricerVariable var, double v, int i, int j){
+    switch(var){
+        case CURRENT_PRICE:  market.editStock(i).setCurrentPrice(v); break;
+        case DRIFT_RATE:     market.editStock(i).setDriftRate(v); break;
+        case DIVIDEND_YIELD: market.editStock(i).setDividendYield(v); break;
+        case VOLATILITY:     market.editStock(i).setVolatility(v); break;
+        case CORRELATION:{
+            // symmetric update, refactorises the correlation matrix
+            matrix corMatrix = market.getCorMatrix();
+            corMatrix.setEntry(i,j,v);
+            corMatrix.setEntry(j,i,v);
+            market.setCorMatrix(corMatrix);
+            break;
+        }
+        case RISK_FREE_RATE: market.setRiskFreeRate(v); break;
+        case STRIKE:         option.setStrike(v); break;
+        case MATURITY:       option.setMaturity(v); break;
+        default: break;
     }
     return v;
 }
@@ -126,30 +185,20 @@ Pricer Pricer::saveAsOriginal(){
 }
 
 double Pricer::BlackScholesClosedForm(){
-    logMessage("starting calculation BlackScholesClosedForm");
+    TRACE_SPAN("BlackScholesClosedForm");
+    logMessage(LOG_DEBUG,"starting calculation BlackScholesClosedForm");
     if(option.getType()=="European"){
-        double K   = getVariable("strike");
-        double T   = getVariable("maturity");
-        double r   = getVariable("riskFreeRate");
-        double S0  = getVariable("currentPrice");
-        double q   = getVariable("dividendYield");
-        double sig = getVariable("volatility");
-        double d1  = (log(S0/K)+(r-q+sig*sig/2)*T)/(sig*sqrt(T));
-        double d2  = d1-sig*sqrt(T);
-        if(option.getPutCall()=="Call")
-            price = S0*exp(-q*T)*normalCDF(d1)-K*exp(-r*T)*normalCDF(d2);
-        else if(option.getPutCall()=="Put")
-            price = K*exp(-r*T)*normalCDF(-d2)-S0*exp(-q*T)*normalCDF(-d1);
+        price = BlackScholesFormula(EUROPEAN,option.getPutCallId(),getPricingInputs());
     }else if(option.getType()=="Margrabe"){
-        double T   = getVariable("maturity");
-        //        double r   = getVariable("riskFreeRate");
-        double S0  = getVariable("currentPrice",0);
-        double S1  = getVariable("currentPrice",1);
-        double q0  = getVariable("dividendYield",0);
-        double q1  = getVariable("dividendYield",1);
-        double sig0 = getVariable("volatility",0);
-        double sig1 = getVariable("volatility",1);
-        double rho = getVariable("correlation",0,1);
+        double T   = getVariable(MATURITY);
+        //        double r   = getVariable(RISK_FREE_RATE);
+        double S0  = getVariable(CURRENT_PRICE,0);
+        double S1  = getVariable(CURRENT_PRICE,1);
+        double q0  = getVariable(DIVIDEND_YIELD,0);
+        double q1  = getVariable(DIVIDEND_YIELD,1);
+        double sig0 = getVariable(VOLATILITY,0);
+        double sig1 = getVariable(VOLATILITY,1);
+        double rho = getVariable(CORRELATION,0,1);
         double sig = sqrt(sig0*sig0+sig1*sig1-2*rho*sig0*sig1);
         double d0  = (log(S0/S1)+(q1-q0+sig*sig/2)*T)/(sig*sqrt(T));
         double d1  = d0-sig*sqrt(T);
@@ -157,46 +206,66 @@ double Pricer::BlackScholesClosedForm(){
             price = S0*exp(-q0*T)*normalCDF(d0)-S1*exp(-q1*T)*normalCDF(d1);
         else if(option.getPutCall()=="Put")
             price = S1*exp(-q1*T)*normalCDF(d1)-S0*exp(-q0*T)*normalCDF(d0);
-    }else if(option.getType()=="Digital"){
-        double K   = getVariable("strike");
-        double T   = getVariable("maturity");
-        double r   = getVariable("riskFreeRate");
-        double S0  = getVariable("currentPrice");
-        double q   = getVariable("dividendYield");
-        double sig = getVariable("volatility");
+    }else if(option.getType()=="Basket"){
         vector<string> nature = option.getNature();
-        if(nature.size()>0){
-            string strikeType = nature[0];
-            if(strikeType=="Double"){
-                vector<double> params = option.getParams();
-                double K0 = params[0];
-                double K1 = params[1];
-                double d01 = (log(S0/K0)+(r-q+sig*sig/2)*T)/(sig*sqrt(T));
-                double d02 = d01-sig*sqrt(T);
-                double d11 = (log(S0/K1)+(r-q+sig*sig/2)*T)/(sig*sqrt(T));
-                double d12 = d11-sig*sqrt(T);
-                if(option.getPutCall()=="Call")
-                    price = exp(-r*T)*(normalCDF(d02)-normalCDF(d12));
-                else if(option.getPutCall()=="Put")
-                    price = exp(-r*T)*(normalCDF(-d02)+normalCDF(d12));
+        if(nature.size()>0 && nature[0]=="Geometric"){
+            // the log of a weighted geometric average of lognormal prices is normal
+            double K   = getVariable(STRIKE);
+            double T   = getVariable(MATURITY);
+            double r   = getVariable(RISK_FREE_RATE);
+            int m = (int)market.getStocks().size();
+            vector<double> w = option.getParams();
+            if((int)w.size()!=m) w = vector<double>(m,1.);
+            double weightSum = 0;
+            for(auto wt:w) weightSum += wt;
+            double mu = 0, var = 0;
+            for(int i=0; i<m; i++){
+                double S0i  = getVariable(CURRENT_PRICE,i);
+                double qi   = getVariable(DIVIDEND_YIELD,i);
+                double sigi = getVariable(VOLATILITY,i);
+                mu += w[i]/weightSum*(log(S0i)+(r-qi-sigi*sigi/2)*T);
+                for(int j=0; j<m; j++){
+                    double rho = market.getCorMatrix().isEmpty()?(i==j):getVariable(CORRELATION,i,j);
+                    var += w[i]*w[j]/(weightSum*weightSum)*rho*sigi*getVariable(VOLATILITY,j)*T;
+                }
             }
+            double d1 = (mu-log(K)+var)/sqrt(var);
+            double d2 = d1-sqrt(var);
+            if(option.getPutCall()=="Call")
+                price = exp(-r*T)*(exp(mu+var/2)*normalCDF(d1)-K*normalCDF(d2));
+            else if(option.getPutCall()=="Put")
+                price = exp(-r*T)*(K*normalCDF(-d2)-exp(mu+var/2)*normalCDF(-d1));
         }
-        double d1 = (log(S0/K)+(r-q+sig*sig/2)*T)/(sig*sqrt(T));
-        double d2 = d1-sig*sqrt(T);
-        if(option.getPutCall()=="Call")
-            price = exp(-r*T)*normalCDF(d2);
-        else if(option.getPutCall()=="Put")
-            price = exp(-r*T)*normalCDF(-d2);
+    }else if(option.getType()=="Digital"){
+        vector<string> nature = option.getNature();
+        if(nature.size()>0 && nature[0]=="Double"){
+            double T   = getVariable(MATURITY);
+            double r   = getVariable(RISK_FREE_RATE);
+            double S0  = getVariable(CURRENT_PRICE);
+            double q   = getVariable(DIVIDEND_YIELD);
+            double sig = getVariable(VOLATILITY);
+            vector<double> params = option.getParams();
+            double K0 = params[0];
+            double K1 = params[1];
+            double d01 = (log(S0/K0)+(r-q+sig*sig/2)*T)/(sig*sqrt(T));
+            double d02 = d01-sig*sqrt(T);
+            double d11 = (log(S0/K1)+(r-q+sig*sig/2)*T)/(sig*sqrt(T));
+            double d12 = d11-sig*sqrt(T);
+            if(option.getPutCall()=="Call")
+                price = exp(-r*T)*(normalCDF(d02)-normalCDF(d12));
+            else if(option.getPutCall()=="Put")
+                price = exp(-r*T)*(normalCDF(-d02)+normalCDF(d12));
+        }else price = BlackScholesFormula(DIGITAL,option.getPutCallId(),getPricingInputs());
     }else if(option.getType()=="Barrier"){
     }else if(option.getType()=="American"){
-        double T = getVariable("maturity");
+        double T = getVariable(MATURITY);
         if(T==INF){
             if(option.getPutCall()=="Put"){
-                double K   = getVariable("strike");
-                double r   = getVariable("riskFreeRate");
-                double S0  = getVariable("currentPrice");
-                //                double q   = getVariable("dividendYield");
-                double sig = getVariable("volatility");
+                double K   = getVariable(STRIKE);
+                double r   = getVariable(RISK_FREE_RATE);
+                double S0  = getVariable(CURRENT_PRICE);
+                //                double q   = getVariable(DIVIDEND_YIELD);
+                double sig = getVariable(VOLATILITY);
                 double sig2 = sig*sig;
                 double k = sig2/(2*r);
                 double s = K/(1+k);
@@ -206,50 +275,163 @@ double Pricer::BlackScholesClosedForm(){
             }
         }
     }
-    logMessage("ending calculation BlackScholesClosedForm, return "+to_string(price));
+    logMessage(LOG_DEBUG,"ending calculation BlackScholesClosedForm, return {}",price);
     return price;
 }
 
-double Pricer::BinomialTreePricer(const SimulationConfig& config){
-    logMessage("starting calculation BinomialTreePricer on config "+to_string(config));
-    Stock stock = market.getStock();
+template <class R>
+R Pricer::BlackScholesFormula(OptionType type, PutCall putCall, const PricingInputs<R>& in){
+    // European and cash-or-nothing Digital, R is double or an AD scalar
+    const R &S0 = in.S0, &K = in.K, &T = in.T, &r = in.r, &q = in.q, &sig = in.sig;
+    R d1 = (log(S0/K)+(r-q+sig*sig/2)*T)/(sig*sqrt(T));
+    R d2 = d1-sig*sqrt(T);
+    if(type==EUROPEAN){
+        if(putCall==CALL) return S0*exp(-q*T)*normalCDF(d1)-K*exp(-r*T)*normalCDF(d2);
+        else if(putCall==PUT) return K*exp(-r*T)*normalCDF(-d2)-S0*exp(-q*T)*normalCDF(-d1);
+    }else if(type==DIGITAL){
+        if(putCall==CALL) return exp(-r*T)*normalCDF(d2);
+        else if(putCall==PUT) return exp(-r*T)*normalCDF(-d2);
+    }
+    return NAN;
+}
+
+template <class R>
+R _PeizerPratt(const R& z, int n){
+    // Peizer-Pratt inversion of the binomial distribution of n steps
+    R a = z/(n+1./3+.1/(n+1));
+    return .5+((z>0)-(z<0))*.5*sqrt(1-exp(-a*a*(n+1./6)));
+}
+
+template <class R>
+R Pricer::_BinomialTreePricer(int n, string method, const PricingInputs<R>& in){
+    // single lattice of n steps over in.T: "CRR", "LR" (Leisen-Reimer, n odd)
+    // or "BBS" (CRR with the Black-Scholes value one step before maturity);
+    // R is double or an AD scalar, differentiated through the induction; latticeNodes counts the terminal
+    // layer and the nodes of the induction band
+    R dt = in.T/n;
+    R sqrt_dt = sqrt(dt);
+    const R &r = in.r, &q = in.q, &sig = in.sig, &S0 = in.S0, &K = in.K;
+    R u, d, qu;
+    if(method=="LR"){
+        // Peizer-Pratt inversion of the terminal binomial probabilities
+        R T = n*dt;
+        R d1 = (log(S0/K)+(r-q+sig*sig/2)*T)/(sig*sqrt(T)), d2 = d1-sig*sqrt(T);
+        R growth = exp((r-q)*dt);
+        qu = _PeizerPratt(d2,n);
+        u = growth*_PeizerPratt(d1,n)/qu;
+        d = (growth-qu*u)/(1-qu);
+    }else{
+        u = exp(sig*sqrt_dt); d = 1/u;
+        qu = (exp((r-q)*dt)-d)/(u-d);
+    }
+    if(!(primal(qu)>=0 && primal(qu)<=1)){
+        // |r-q|*dt beyond sig*sqrt(dt): the steps are too coarse for a risk-neutral up probability
+        logMessage(LOG_WARN,"_BinomialTreePricer: {} up probability {} outside [0,1] at {} steps, use more steps",
+                   method,primal(qu),n);
+        return R(NAN);
+    }
+    R qd = 1-qu;
+    R disc = exp(-r*dt);
+    double w = (option.getPutCallId()==CALL)?1:-1;
+    bool early = option.canEarlyExercise();
+    bool vanilla = option.getTypeId()==EUROPEAN || early;
+    bool callPut = option.getTypeId()==EUROPEAN || option.getTypeId()==AMERICAN;
+    // BBS smooths the payoff kink by starting induction one step early from Black-Scholes values
+    int m = (method=="BBS" && vanilla && n>1)?n-1:n;
+    vector<R> V(m+1);
+    R ud = u/d, S = S0*pow(d,m);
+    for(int j=0; j<=m; j++, S*=ud){
+        if(m<n){
+            R d1 = (log(S/K)+(r-q+sig*sig/2)*dt)/(sig*sqrt_dt), d2 = d1-sig*sqrt_dt;
+            V[j] = w*(S*exp(-q*dt)*normalCDF(w*d1)-K*disc*normalCDF(w*d2));
+            if(early) V[j] = max(V[j],R(w*(S-K)));
+        }else if(callPut) V[j] = max(R(w*(S-K)),R(0.)); // in the scalar type, to carry the derivatives in S0 and K
+        else V[j] = option.calcPayoff(primal(S));
+    }
+    latticeNodes += m+1;
+    R value;
+    if(!early){
+        // no early exercise: discounted expectation over the binomial distribution, O(n)
+        double logMFact = lgamma(m+1.);
+        R logQu = log(qu), logQd = log(qd);
+        value = 0;
+        for(int j=0; j<=m; j++)
+            value += exp(logMFact-lgamma(j+1.)-lgamma(m-j+1.)+j*logQu+(m-j)*logQd)*V[j];
+        value *= pow(disc,m);
+    }else{
+        // backward induction on a single rolling vector of option values, node prices
+        // S0*d^i*(u/d)^j on the fly; only nodes within 8.5 standard deviations of the
+        // mean are updated, those further out carry no weight in double precision
+        R a = disc*qu, b = disc*qd;
+        double band = 8.5*sqrt((double)m)/2+1;
+        for(int i=m-1; i>=0; i--){
+            double center = i*primal(qu);
+            int j0 = max(0,(int)floor(center-band)), j1 = min(i,(int)ceil(center+band));
+            R *Vi = V.data();
+            S = S0*pow(d,i)*pow(ud,j0);
+            for(int j=j0; j<=j1; j++, S*=ud)
+                Vi[j] = max(R(a*Vi[j+1]+b*Vi[j]),R(w*(S-K)));
+            latticeNodes += j1-j0+1;
+        }
+        value = V[0];
+    }
+    return value;
+}
+
+template <class R>
+R Pricer::_BinomialTreeValue(const SimulationConfig& config, string method, const PricingInputs<R>& in){
+    // method: "CRR", "LR", "BBS", or "LRR"/"BBSR" for two-point Richardson extrapolation
+    // on n and n/2 steps of the same maturity in.T
     int n = config.iters;
-    double dt = config.stepSize;
-    double sqrt_dt = sqrt(dt);
-    double r = getVariable("riskFreeRate");
-    double q = getVariable("dividendYield");
-    double sig = getVariable("volatility");
-    double u = exp(sig*sqrt_dt), d = 1/u;
-    double qu = (exp((r-q)*dt)-d)/(u-d), qd = 1-qu;
-    stock.setDriftRate(r-q);
-    stock.generatePriceTree(config);
-    matrix optionBinomialTree(n,n);
+    R value = NAN;
     if(!option.isPathDependent()){
-        matrix payoffs = option.calcPayoffs(stock.getBinomialPriceTree().getLastRow());
-        optionBinomialTree.setRow(n-1,payoffs);
-        for(int i=n-2; i>=0; i--){
-            for(int j=0; j<i+1; j++)
-                optionBinomialTree.setEntry(i,j,max(
-                                                    exp(-r*dt)*(qu*optionBinomialTree.getEntry(i+1,j+1)+qd*optionBinomialTree.getEntry(i+1,j)),
-                                                    (option.canEarlyExercise())?option.calcPayoff(stock.getBinomialPriceTree().getEntry(i,j)):0.
-                                                    ));
+        if(method=="CRR" || method=="BBS"){
+            value = _BinomialTreePricer(n,method,in);
+        }else if(method=="LR"){
+            n |= 1;
+            value = _BinomialTreePricer(n,"LR",in);
+        }else if(method=="BBSR"){
+            // error O(1/n); a single step has no coarser lattice and falls back to plain BBS
+            int n1 = max(n/2,1);
+            if(n1>=n) value = _BinomialTreePricer(n,"BBS",in);
+            else value = (n*_BinomialTreePricer(n,"BBS",in)-n1*_BinomialTreePricer(n1,"BBS",in))/(n-n1);
+        }else if(method=="LRR"){
+            // error O(1/n^2) on odd step counts, O(1/n) once early exercise is allowed; a single step falls
+            // back to plain LR
+            n |= 1;
+            int n1 = (n/2)|1;
+            double order = option.canEarlyExercise()?1:2;
+            double w = pow((double)n,order), w1 = pow((double)n1,order);
+            if(n1>=n) value = _BinomialTreePricer(n,"LR",in);
+            else value = (w*_BinomialTreePricer(n,"LR",in)-w1*_BinomialTreePricer(n1,"LR",in))/(w-w1);
         }
-        // cout << stock.getBinomialPriceTree().print() << endl;
-        // cout << optionBinomialTree.print() << endl;
-        price = optionBinomialTree.getEntry(0,0);
     }
-    logMessage("ending calculation BinomialTreePricer, return "+to_string(price));
+    return value;
+}
+
+double Pricer::BinomialTreePricer(const SimulationConfig& config, string method){
+    TRACE_SPAN_COUNTER(span,"BinomialTreePricer","nodes"); // nodes visited by every lattice of the method
+    // the lattice spans config.iters steps of config.stepSize, see _BinomialTreeValue for the methods
+    logMessage(LOG_DEBUG,"starting calculation BinomialTreePricer on config {} method {}",config,method);
+    PricingInputs<double> in = getPricingInputs();
+    in.T = config.iters*config.stepSize;
+    latticeNodes = 0;
+    price = _BinomialTreeValue(config,method,in);
+    TRACE_ADD_ITEMS(span,latticeNodes);
+    logMessage(LOG_DEBUG,"ending calculation BinomialTreePricer, return {}",price);
     return price;
 }
 
 double Pricer::MonteCarloPricer(const SimulationConfig& config, int numSim, string method){
-    logMessage("starting calculation MonteCarloPricer on config "+to_string(config)+", numSim "+to_string(numSim));
+    TRACE_SPAN_ITEMS("MonteCarloPricer","paths",numSim);
+    logMessage(LOG_DEBUG,"starting calculation MonteCarloPricer on config {}, numSim {}",config,numSim);
     int n = config.iters;
     Stock stock = market.getStock();
-    double r = getVariable("riskFreeRate");
-    double q = getVariable("dividendYield");
-    double T = getVariable("maturity");
+    double r = getVariable(RISK_FREE_RATE);
+    double q = getVariable(DIVIDEND_YIELD);
+    double T = getVariable(MATURITY);
     double err = NAN;
+    vector<double> lsmBounds; // {lower, lowerErr, upper, upperErr} for early exercise
     matrix simPriceMatrix, simTimeVector;
     stock.setDriftRate(r-q);
     // handle exceptions ================
@@ -267,15 +449,74 @@ double Pricer::MonteCarloPricer(const SimulationConfig& config, int numSim, stri
         stock.setDriftRate(r-q-lamJ*muJ);
     }
     // ==================================
+    simGreeks = simGreekErrs = NULL_GREEKS;
     if(method=="simple"){
-        simPriceMatrix = stock.simulatePrice(config,numSim);
-        simTimeVector = stock.getSimTimeVector();
         if(!option.canEarlyExercise()){
-            matrix payoffs = option.calcPayoffs(NULL_VECTOR,simPriceMatrix,{},simTimeVector);
-            price = exp(-r*T)*payoffs.mean();
-            err = exp(-r*T)*payoffs.stdev()/sqrt(numSim);
+            vector<double> payoffs(numSim);
+            vector<double> greekSums; // per greek, sum and sum of squares of the path estimates
+            bool evaluated = true;
+            bool withGreeks = config.simGreeks && dynamics=="lognormal";
+            simTimeVector.setRange(0,n*config.stepSize,n,true);
+            if(PathBuffer::parseLayout(config.pathLayout)==TILED){
+                // generate and evaluate one cache-sized tile at a time, never holding all paths
+                int tilePaths = config.tilePaths>0?config.tilePaths:PathBuffer::calcTilePaths(n+1);
+                vector<double> tile((size_t)(n+1)*tilePaths);
+                for(int j0=0; j0<numSim && evaluated; j0+=tilePaths){
+                    int width = min(tilePaths,numSim-j0);
+                    PathBlock block = {&tile[0],n+1,j0,width,width,1};
+                    {
+                        TRACE_SPAN("MonteCarloPricer:paths");
+                        evaluated = stock.simulatePriceBlock(config,block);
+                    }
+                    if(evaluated){
+                        TRACE_SPAN("MonteCarloPricer:payoffs");
+                        evaluated = option.calcPayoffsBlock(block,&payoffs[j0],simTimeVector,config.barrierCorrection,stock.getVolatility());
+                    }
+                    if(evaluated && withGreeks)
+                        withGreeks = _MonteCarloGreeksBlock(stock,config,block,&payoffs[0],simTimeVector,greekSums);
+                }
+            }else{
+                PathBuffer simPaths;
+                {
+                    TRACE_SPAN("MonteCarloPricer:paths");
+                    simPaths = stock.simulatePricePaths(config,numSim);
+                }
+                TRACE_SPAN("MonteCarloPricer:payoffs");
+                matrix V = option.calcPayoffs(simPaths,simTimeVector,config.barrierCorrection,stock.getVolatility());
+                evaluated = !V.isEmpty();
+                if(evaluated) payoffs = V.getRowVector(0);
+                for(int b=0; b<simPaths.getNumBlocks() && evaluated && withGreeks; b++)
+                    withGreeks = _MonteCarloGreeksBlock(stock,config,simPaths.getBlock(b),&payoffs[0],simTimeVector,greekSums);
+            }
+            if(!evaluated){
+                withGreeks = false;
+                simPriceMatrix = stock.simulatePrice(config,numSim);
+                simTimeVector = stock.getSimTimeVector();
+                payoffs = option.calcPayoffs(NULL_VECTOR,simPriceMatrix,{},simTimeVector).getRowVector(0);
+            }
+            TRACE_SPAN("MonteCarloPricer:reduction");
+            double sum = 0, sum2 = 0;
+            for(double V:payoffs){sum += V; sum2 += V*V;}
+            double mean = sum/numSim, var = (sum2-sum*mean)/(numSim-1);
+            price = exp(-r*T)*mean;
+            err = exp(-r*T)*sqrt(var/numSim);
+            if(withGreeks){
+                double *greek[4] = {&simGreeks.delta,&simGreeks.gamma,&simGreeks.vega,&simGreeks.rho};
+                double *greekErr[4] = {&simGreekErrs.delta,&simGreekErrs.gamma,&simGreekErrs.vega,&simGreekErrs.rho};
+                for(int k=0; k<4; k++){
+                    double mean = greekSums[2*k]/numSim;
+                    double var = max((greekSums[2*k+1]-greekSums[2*k]*mean)/(numSim-1),0.);
+                    *greek[k] = exp(-r*T)*mean;
+                    *greekErr[k] = exp(-r*T)*sqrt(var/numSim);
+                }
+                simGreeks.price = price;
+                simGreekErrs.price = err;
+            }
         }else{
-            // Longstaff-Schwartz algorithm
+            vector<double> lsmCalc = _LongstaffSchwartzPricer(stock,config,numSim);
+            price = lsmCalc[0];
+            err = lsmCalc[1];
+            lsmBounds.assign(lsmCalc.begin()+2,lsmCalc.end());
         }
     }else if(method=="antithetic variates"){
         matrix simPriceMatrix0, simPriceMatrix1;
@@ -292,60 +533,451 @@ double Pricer::MonteCarloPricer(const SimulationConfig& config, int numSim, stri
             err = exp(-r*T)*payoffs.stdev()/sqrt(numSim);
         }
     }else if(method=="control variates"){
-        simPriceMatrix = stock.simulatePrice(config,numSim);
-        simTimeVector = stock.getSimTimeVector();
-        if(!option.canEarlyExercise()){
-            matrix payoffs = option.calcPayoffs(NULL_VECTOR,simPriceMatrix,{},simTimeVector);
-            price = exp(-r*T)*payoffs.mean();
-            err = exp(-r*T)*payoffs.stdev()/sqrt(numSim);
+        // control payoff evaluated on the same paths: the European for vanilla-like payoffs, American and
+        // Bermudan, and the geometric Asian for fixed-strike Asian, both in closed form on lognormal stocks,
+        // otherwise the terminal stock price, whose expectation S0*(1+mu*dt)^n is exact under the Euler scheme
+        // for lognormal and jump-diffusion (not Heston, whose price step uses the updated variance); a
+        // European is its own European control, so it takes the terminal price too
+        double dt = config.stepSize;
+        double S0 = stock.getCurrentPrice();
+        double K = option.getStrike();
+        double sig = stock.getVolatility();
+        string putCall = option.getPutCall();
+        vector<string> nature = option.getNature();
+        PathBuffer simPaths = stock.simulatePricePaths(config,numSim);
+        simTimeVector.setRange(0,n*dt,n,true);
+        vector<double> cvPayoffs(numSim);
+        Option cvOption;
+        double cvMean = NAN;
+        if(dynamics=="lognormal"){
+            if(optionType=="Digital" || optionType=="Barrier" || optionType=="Lookback" ||
+               optionType=="Chooser" || option.canEarlyExercise()){
+                cvOption = Option("European",putCall=="Put"?"Put":"Call",K,T);
+                cvMean = exp(r*T)*Pricer(cvOption,market).BlackScholesClosedForm();
+            }else if(optionType=="Asian" && !(nature.size()>1 && nature[1]=="Float")){
+                // log of the geometric average over the n+1 fixings is normal
+                cvOption = Option("Asian",putCall,K,T,{},{"Geometric"});
+                double mu = log(S0)+(r-q-sig*sig/2)*dt*n/2;
+                double var = sig*sig*dt*n*(2*n+1)/(6.*(n+1));
+                double d1 = (mu-log(K)+var)/sqrt(var), d2 = d1-sqrt(var);
+                if(putCall=="Call") cvMean = exp(mu+var/2)*normalCDF(d1)-K*normalCDF(d2);
+                else cvMean = K*normalCDF(-d2)-exp(mu+var/2)*normalCDF(-d1);
+            }
+        }
+        if(!isnan(cvMean)) cvPayoffs = cvOption.calcPayoffs(simPaths,simTimeVector).getRowVector(0);
+        else if(dynamics=="lognormal" || dynamics=="jump-diffusion"){
+            double growth = 1+stock.getDriftRate()*dt;
+            if(dynamics=="jump-diffusion"){
+                vector<double> params = stock.getDynParams();
+                growth += params[0]*dt*params[1]*dt;
+            }
+            for(int j=0; j<numSim; j++) cvPayoffs[j] = simPaths.getEntry(n,j);
+            cvMean = S0*pow(growth,n);
+        }
+        if(option.canEarlyExercise()){
+            // the regression and the control share the paths, the control is discounted as the cash flows are
+            for(double& X:cvPayoffs) X *= exp(-r*T);
+            vector<double> lsmCalc = _LongstaffSchwartzPricer(stock,config,numSim,&simPaths,cvPayoffs,cvMean*exp(-r*T));
+            price = lsmCalc[0];
+            err = lsmCalc[1];
+            lsmBounds.assign(lsmCalc.begin()+2,lsmCalc.end());
+        }else{
+            matrix V = option.calcPayoffs(simPaths,simTimeVector,config.barrierCorrection,sig);
+            if(V.isEmpty()) V = option.calcPayoffs(NULL_VECTOR,simPaths.toMatrix(),{},simTimeVector);
+            vector<double> payoffs = V.getRowVector(0);
+            if(!isnan(cvMean)) applyControlVariate(payoffs,cvPayoffs,cvMean);
+            double sum = 0, sum2 = 0;
+            for(double V:payoffs){sum += V; sum2 += V*V;}
+            double mean = sum/numSim, var = max((sum2-sum*mean)/(numSim-1),0.);
+            price = exp(-r*T)*mean;
+            err = exp(-r*T)*sqrt(var/numSim);
         }
-        Pricer refPricer(option,market);
-        refPricer.setStringVariable("optionType","European");
-        double refPriceMonte = refPricer.MonteCarloPricer(config,numSim);
-        double refPriceClosed = refPricer.BlackScholesClosedForm();
-        double refErr = refPricer.tmp[0];
-        price += refPriceClosed-refPriceMonte;
-        err = sqrt(err*err+refErr*refErr); // assume uncorrelated MC estimates
     }
     tmp = {err};
-    logMessage("ending calculation MonteCarloPricer, return "+to_string(price)+" with error "+to_string(err));
+    tmp.insert(tmp.end(),lsmBounds.begin(),lsmBounds.end());
+    logMessage(LOG_DEBUG,"ending calculation MonteCarloPricer, return {} with error {}",price,err);
     return price;
 }
 
+bool Pricer::_MonteCarloGreeksBlock(const Stock& stock, const SimulationConfig& config, const PathBlock& block,
+                                    const double *payoffs, const matrix& simTimeVector, vector<double>& sums){
+    // per-path delta, gamma, vega and rho estimates, undiscounted, on lognormal Euler paths
+    // S(i) = S(i-1)*(m0+m1*z(i)) whose normals z are recovered from the path itself
+    // pathwise for Lipschitz payoffs: the payoff is differentiated along the tangent path dS/dtheta
+    // (one-sided over a small bump) and gamma mixes the pathwise delta with the likelihood-ratio score
+    // likelihood ratio for Digital and Barrier: the payoff is weighted by the score of the path density
+    // the S0-score rescales the first m steps, all of them when the payoff only reads the terminal price
+    // and only the first step otherwise so that the whole path is scaled exactly; the payoff then still
+    // reads S0 itself at step 0, whose first derivative is added to the mixed gamma (second derivatives
+    // in S0 alone are dropped, a small bias for Asian whose average has a kink)
+    // sums holds, per greek, the sum and the sum of squares over paths
+    int n = block.steps-1, w = block.width;
+    if(n<1) return false;
+    double dt = config.stepSize, sqrt_dt = sqrt(dt);
+    double S0 = stock.getCurrentPrice(), sig = stock.getVolatility();
+    double T = getVariable(MATURITY);
+    double m0 = 1+stock.getDriftRate()*dt, m1 = sig*sqrt_dt, K = m0/m1;
+    double h = 1e-6; // relative bump of the tangent paths
+    OptionType type = option.getTypeId();
+    bool likelihoodRatio = (type==DIGITAL || type==BARRIER);
+    int m = (type==EUROPEAN || type==DIGITAL)?n:1;
+    sums.resize(8,0.);
+    auto getS = [&](int i, int j){return block.data[(size_t)i*block.stepStride+(size_t)j*block.pathStride];};
+    vector<double> fS, fSig, fR, f0; // payoffs on the tangent paths and with step 0 bumped
+    if(!likelihoodRatio){
+        vector<double> pathS((size_t)(n+1)*w), pathSig((size_t)(n+1)*w), pathR((size_t)(n+1)*w), path0;
+        for(int j=0; j<w; j++){
+            double dSig = 0, dR = 0; // relative tangents (dS/dsig)/S and (dS/dr)/S
+            for(int i=0; i<=n; i++){
+                double S = getS(i,j);
+                if(i>0){
+                    double g = S/getS(i-1,j);
+                    dSig += (g-m0)/(sig*g);
+                    dR += dt/g;
+                }
+                pathS[(size_t)i*w+j] = S*(1+h);
+                pathSig[(size_t)i*w+j] = S*(1+h*sig*dSig);
+                pathR[(size_t)i*w+j] = S*(1+h*dR);
+            }
+        }
+        fS.resize(w); fSig.resize(w); fR.resize(w);
+        PathBlock blockS = {&pathS[0],n+1,block.path0,w,w,1}, blockSig = {&pathSig[0],n+1,block.path0,w,w,1},
+        blockR = {&pathR[0],n+1,block.path0,w,w,1};
+        if(!option.calcPayoffsBlock(blockS,&fS[0],simTimeVector,config.barrierCorrection,sig) ||
+           !option.calcPayoffsBlock(blockSig,&fSig[0],simTimeVector,config.barrierCorrection,sig*(1+h)) ||
+           !option.calcPayoffsBlock(blockR,&fR[0],simTimeVector,config.barrierCorrection,sig)) return false;
+        if(m<n){
+            path0.resize((size_t)(n+1)*w);
+            for(int i=0; i<=n; i++) for(int j=0; j<w; j++) path0[(size_t)i*w+j] = getS(i,j);
+            for(int j=0; j<w; j++) path0[j] *= 1+h;
+            f0.resize(w);
+            PathBlock block0 = {&path0[0],n+1,block.path0,w,w,1};
+            if(!option.calcPayoffsBlock(block0,&f0[0],simTimeVector,config.barrierCorrection,sig)) return false;
+        }
+    }
+    for(int j=0; j<w; j++){
+        double f = payoffs[block.path0+j];
+        double A = 0, B = 0, scoreSig = 0, scoreR = 0;
+        for(int i=1; i<=n; i++){
+            double z = (getS(i,j)/getS(i-1,j)-m0)/m1;
+            if(i<=m){A += z*(z+K); B += (z+K)*(z+K);}
+            scoreSig += (z*z-1)/sig;
+            scoreR += z*sqrt_dt/sig;
+        }
+        A /= m; B /= (double)m*m;
+        double l1 = A-1, l2 = 1-B-A*(1+1./m); // first and second derivatives of the log density in S0/S0
+        double greek[4];
+        if(likelihoodRatio){
+            greek[0] = f*l1/S0;
+            greek[1] = f*(l1*l1+l2)/(S0*S0);
+            greek[2] = f*scoreSig;
+            greek[3] = f*(scoreR-T);
+        }else{
+            double D = (fS[j]-f)/h; // derivative along the path itself, S0*delta
+            greek[0] = D/S0;
+            greek[1] = D*(l1-1)/(S0*S0);
+            if(m<n) greek[1] += (f0[j]-f)/(h*S0*S0);
+            greek[2] = (fSig[j]-f)/(h*sig);
+            greek[3] = (fR[j]-f)/h-T*f;
+        }
+        for(int k=0; k<4; k++){
+            sums[2*k] += greek[k];
+            sums[2*k+1] += greek[k]*greek[k];
+        }
+    }
+    return true;
+}
+
+vector<double> Pricer::_LongstaffSchwartzPricer(const Stock& stock, const SimulationConfig& config, int numSim,
+                                                const PathBuffer *paths, const vector<double>& cvPayoffs, double cvMean){
+    // backward induction over the exercise steps, regressing the discounted cash flows of in-the-money paths
+    // on a basis of S/K; the normal equations are accumulated per chunk of paths in parallel, reduced in
+    // chunk order (reproducible for any thread count) and solved by Eigen
+    // returns {price, err, lower, lowerErr, upper, upperErr}; on config.lsmBoundPaths independent paths the
+    // fitted rule gives a low-biased estimate and, with config.lsmInnerPaths, the Andersen-Broadie dual
+    // (nested simulation, not for Heston whose variance is not in the path) gives a high-biased one;
+    // the regression runs on paths if given, and with cvMean the realised cash flows are adjusted by the
+    // control cvPayoffs (discounted, on the same paths) whose expectation is cvMean
+    int n = config.iters;
+    double dt = config.stepSize;
+    double r = getVariable(RISK_FREE_RATE);
+    double K = option.getStrike();
+    bool isPut = option.getPutCallId()==PUT;
+    bool laguerre = config.lsmBasis!="monomial";
+    int p = config.lsmDegree+1;
+    Stock simStock(stock);
+    // exercise at every step for American, at the steps closest to the times in params for Bermudan
+    vector<bool> canExercise(n+1,option.getTypeId()==AMERICAN);
+    vector<double> exTimes = option.getParams();
+    if(option.getTypeId()==BERMUDAN && exTimes.empty()) canExercise.assign(n+1,true);
+    for(double t:exTimes){
+        int i = (int)round(t/dt);
+        if(option.getTypeId()==BERMUDAN && i>=0 && i<=n) canExercise[i] = true;
+    }
+    canExercise[n] = true;
+    vector<double> disc(n+1);
+    for(int i=0; i<=n; i++) disc[i] = exp(-r*i*dt);
+    auto exercise = [&](double S){return max(isPut?K-S:S-K,0.);};
+    vector<vector<double>> beta(n+1); // regression coefficients per step, empty where none was fitted
+    auto stopAt = [&](int i, double S, double *phi){
+        // fitted rule: exercise when the discounted exercise value beats the estimated continuation
+        double h = exercise(S);
+        if(beta[i].empty() || h<=0) return false;
+        calcLsmBasis(S/K,laguerre,p-1,phi);
+        return disc[i]*h>=inner_product(phi,phi+p,beta[i].begin(),0.);
+    };
+    auto policyValue = [&](const double *path, size_t stride, int k0, double *phi){
+        // discounted payoff of the fitted rule strictly after step k0, path[(i-k0)*stride] is the price at step i
+        for(int i=k0+1; i<n; i++)
+            if(stopAt(i,path[(i-k0)*stride],phi)) return disc[i]*exercise(path[(i-k0)*stride]);
+        return disc[n]*exercise(path[(n-k0)*stride]);
+    };
+    auto meanAndErr = [](const vector<double>& V){
+        double sum = 0, sum2 = 0;
+        for(double v:V){sum += v; sum2 += v*v;}
+        int m = (int)V.size();
+        double mean = sum/m, var = max((sum2-sum*mean)/(m-1),0.);
+        return vector<double>{mean,sqrt(var/m)};
+    };
+    /**** regression ****/
+    PathBuffer simPaths;
+    if(!paths){
+        TRACE_SPAN("LongstaffSchwartz:paths");
+        simPaths = simStock.simulatePricePaths(config,numSim);
+    }
+    vector<PathBlock> chunks = splitPathBlocks(paths?*paths:simPaths,LSM_CHUNK);
+    int numChunks = (int)chunks.size();
+    vector<double> C(numSim); // realised cash flow of each path, discounted to time 0
+    parallelFor(numChunks,[&](int c){
+        const PathBlock& block = chunks[c];
+        const double *S = block.data+(size_t)n*block.stepStride;
+        for(int j=0; j<block.width; j++) C[block.path0+j] = disc[n]*exercise(S[(size_t)j*block.pathStride]);
+    },config.numThreads);
+    int sizeAB = p*p+p;
+    vector<double> chunkAB((size_t)numChunks*sizeAB);
+    vector<int> chunkItm(numChunks);
+    for(int i=n-1; i>0; i--){
+        if(!canExercise[i]) continue;
+        TRACE_SPAN("LongstaffSchwartz:regression");
+        fill(chunkAB.begin(),chunkAB.end(),0.);
+        parallelFor(numChunks,[&](int c){
+            const PathBlock& block = chunks[c];
+            const double *S = block.data+(size_t)i*block.stepStride;
+            double *A = &chunkAB[(size_t)c*sizeAB], *b = A+p*p;
+            vector<double> phi(p);
+            int itm = 0;
+            for(int j=0; j<block.width; j++){
+                double Sj = S[(size_t)j*block.pathStride];
+                if(exercise(Sj)<=0) continue;
+                calcLsmBasis(Sj/K,laguerre,p-1,&phi[0]);
+                double Y = C[block.path0+j];
+                for(int u=0; u<p; u++){
+                    b[u] += phi[u]*Y;
+                    for(int v=0; v<=u; v++) A[u*p+v] += phi[u]*phi[v];
+                }
+                itm++;
+            }
+            chunkItm[c] = itm;
+        },config.numThreads);
+        MatrixXd A = MatrixXd::Zero(p,p);
+        VectorXd b = VectorXd::Zero(p);
+        int numItm = 0;
+        for(int c=0; c<numChunks; c++){
+            const double *Ac = &chunkAB[(size_t)c*sizeAB], *bc = Ac+p*p;
+            for(int u=0; u<p; u++){
+                b(u) += bc[u];
+                for(int v=0; v<=u; v++) A(u,v) += Ac[u*p+v];
+            }
+            numItm += chunkItm[c];
+        }
+        if(numItm<=p) continue; // too few paths in the money to fit, never exercise here
+        VectorXd x;
+        {
+            TRACE_SPAN("LongstaffSchwartz:linearSolve");
+            x = A.ldlt().solve(b); // lower triangle only
+        }
+        beta[i].assign(x.data(),x.data()+p);
+        parallelFor(numChunks,[&](int c){
+            const PathBlock& block = chunks[c];
+            const double *S = block.data+(size_t)i*block.stepStride;
+            vector<double> phi(p);
+            for(int j=0; j<block.width; j++){
+                double Sj = S[(size_t)j*block.pathStride];
+                if(stopAt(i,Sj,&phi[0])) C[block.path0+j] = disc[i]*exercise(Sj);
+            }
+        },config.numThreads);
+    }
+    double S0 = simStock.getCurrentPrice();
+    double h0 = canExercise[0]?exercise(S0):0;
+    if(!isnan(cvMean)) applyControlVariate(C,cvPayoffs,cvMean);
+    vector<double> lsmCalc = meanAndErr(C);
+    lsmCalc[0] = max(lsmCalc[0],h0);
+    /**** bounds ****/
+    vector<double> lower = {NAN,NAN}, upper = {NAN,NAN};
+    int m = config.lsmBoundPaths;
+    if(m>1){
+        // a seeded config would replay the regression paths, the bounds need independent ones
+        SimulationConfig boundConfig = config;
+        if(config.seed) boundConfig.seed = config.seed+1;
+        PathBuffer boundPaths = simStock.simulatePricePaths(boundConfig,m);
+        vector<PathBlock> boundChunks = splitPathBlocks(boundPaths,LSM_CHUNK);
+        vector<double> L(m);
+        parallelFor((int)boundChunks.size(),[&](int c){
+            const PathBlock& block = boundChunks[c];
+            vector<double> phi(p);
+            for(int j=0; j<block.width; j++)
+                L[block.path0+j] = policyValue(block.data+(size_t)j*block.pathStride,block.stepStride,0,&phi[0]);
+        },config.numThreads);
+        lower = meanAndErr(L);
+        lower[0] = max(lower[0],h0);
+        int numInner = config.lsmInnerPaths;
+        if(numInner>0 && simStock.getDynamics()!="Heston"){
+            // M accumulates L(next)-Q(k) over the exercise dates, L the rule's value and Q=E_k[L(next)]
+            // estimated by inner paths from S_k; the bound is E[max_k (h_k-M_k)] over exercisable steps
+            vector<int> dates = {0};
+            for(int i=1; i<=n; i++) if(canExercise[i]) dates.push_back(i);
+            Stock innerStock(simStock);
+            vector<double> phi(p), U(m);
+            auto continuation = [&](int o, int k, double S){
+                innerStock.setCurrentPrice(S);
+                SimulationConfig innerConfig(dt*(n-k),n-k);
+                if(config.seed) innerConfig.seed = config.seed+2+(unsigned long)o*(n+1)+k;
+                PathBuffer innerPaths = innerStock.simulatePricePaths(innerConfig,numInner);
+                PathBlock block = innerPaths.getBlock(0);
+                double sum = 0;
+                for(int j=0; j<numInner; j++){
+                    sum += policyValue(block.data+(size_t)j*block.pathStride,block.stepStride,k,&phi[0]);
+                }
+                return sum/numInner;
+            };
+            for(int o=0; o<m; o++){
+                double M = 0, Q = continuation(o,0,S0);
+                double Umax = canExercise[0]?h0:-INFINITY;
+                for(int d=1; d<(int)dates.size(); d++){
+                    int i = dates[d];
+                    double S = boundPaths.getEntry(i,o), h = disc[i]*exercise(S);
+                    double Qi = (i<n)?continuation(o,i,S):h;
+                    M += ((i==n || stopAt(i,S,&phi[0]))?h:Qi)-Q;
+                    Umax = max(Umax,h-M);
+                    Q = Qi;
+                }
+                U[o] = Umax;
+            }
+            upper = meanAndErr(U);
+        }
+    }
+    lsmCalc.insert(lsmCalc.end(),lower.begin(),lower.end());
+    lsmCalc.insert(lsmCalc.end(),upper.begin(),upper.end());
+    return lsmCalc;
+}
+
 double Pricer::MultiStockMonteCarloPricer(const SimulationConfig& config, int numSim, string method){
-    logMessage("starting calculation MonteCarloPricer on config "+to_string(config)+", numSim "+to_string(numSim));
+    TRACE_SPAN_ITEMS("MultiStockMonteCarloPricer","paths",numSim);
+    logMessage(LOG_DEBUG,"starting calculation MonteCarloPricer on config {}, numSim {}",config,numSim);
     //    int n = config.iters;
-    double r = getVariable("riskFreeRate");
-    double T = getVariable("maturity");
+    double r = getVariable(RISK_FREE_RATE);
+    double T = getVariable(MATURITY);
     Market rnMarket(market); // risk-neutral market
     vector<Stock> stocks = rnMarket.getStocks();
     for(auto& stock:stocks){
         double q = stock.getDividendYield();
         stock.setDriftRate(r-q);
+        if(stock.getDynamics()=="jump-diffusion"){
+            vector<double> params = stock.getDynParams();
+            stock.setDriftRate(r-q-params[0]*params[1]);
+        }
     }
     rnMarket.setStocks(stocks);
     double err = NAN;
     vector<matrix> simPriceMatrixSet;
-    if(method=="simple"){
-        simPriceMatrixSet = rnMarket.simulateCorrelatedPrices(config,numSim);
+    if(method=="simple" || method=="antithetic variates" || method=="control variates"){
         if(!option.canEarlyExercise()){
-            matrix payoffs = option.calcPayoffs(NULL_VECTOR,NULL_MATRIX,simPriceMatrixSet);
-            price = exp(-r*T)*payoffs.mean();
-            err = exp(-r*T)*payoffs.stdev()/sqrt(numSim);
+            // simulate and evaluate chunk by chunk across threads, never holding all paths of all stocks
+            int n = config.iters;
+            int m = (int)stocks.size();
+            int numChunks = (numSim+MULTI_STOCK_CHUNK-1)/MULTI_STOCK_CHUNK;
+            unsigned long seed = config.seed?config.seed:rand();
+            bool antithetic = method=="antithetic variates";
+            bool control = method=="control variates";
+            // control variate with a known mean on lognormal stocks: the terminal spread S0-S1 for Margrabe,
+            // whose mean is exact under the Euler scheme (the exchange option would be its own control), the
+            // geometric basket in closed form for Basket and Rainbow
+            Option cvOption;
+            double cvMean = NAN;
+            bool spread = false;
+            if(control){
+                bool lognormal = true;
+                for(auto& stock:stocks) lognormal = lognormal && stock.getDynamics()=="lognormal";
+                string type = option.getType();
+                string putCall = (type=="Rainbow" && option.getNature()[0]=="Best")?"Call":option.getPutCall();
+                double dt = config.stepSize;
+                if(!lognormal) cvOption = Option();
+                else if(type=="Margrabe"){
+                    spread = true;
+                    cvMean = stocks[0].getCurrentPrice()*pow(1+stocks[0].getDriftRate()*dt,n)-
+                    stocks[1].getCurrentPrice()*pow(1+stocks[1].getDriftRate()*dt,n);
+                }else if(type=="Basket") cvOption = Option("Basket",putCall,option.getStrike(),T,option.getParams(),{"Geometric"});
+                else if(type=="Rainbow") cvOption = Option("Basket",putCall,option.getStrike(),T,{},{"Geometric"});
+                if(!cvOption.getType().empty()) cvMean = exp(r*T)*Pricer(cvOption,market).BlackScholesClosedForm();
+                control = !isnan(cvMean);
+            }
+            vector<double> payoffs(numSim), cvPayoffs(control?numSim:0);
+            atomic<bool> evaluated(true);
+            parallelFor(numChunks,[&](int c){
+                int j0 = c*MULTI_STOCK_CHUNK, width = min(MULTI_STOCK_CHUNK,numSim-j0);
+                vector<double> tile((size_t)m*(n+1)*width);
+                vector<PathBlock> blocks(m);
+                for(int a=0; a<m; a++) blocks[a] = {&tile[(size_t)a*(n+1)*width],n+1,j0,width,width,1};
+                mt19937_64 gen = randomEngine(seed,j0), gen1 = gen;
+                bool ok;
+                {
+                    TRACE_SPAN("MultiStockMonteCarloPricer:paths");
+                    ok = rnMarket.simulateCorrelatedBlock(config,blocks,gen);
+                }
+                TRACE_SPAN("MultiStockMonteCarloPricer:payoffs");
+                ok = ok && option.calcPayoffsBlock(blocks,&payoffs[j0]);
+                if(ok && spread)
+                    for(int j=0; j<width; j++)
+                        cvPayoffs[j0+j] = blocks[0].data[(size_t)n*blocks[0].stepStride+(size_t)j*blocks[0].pathStride]-
+                        blocks[1].data[(size_t)n*blocks[1].stepStride+(size_t)j*blocks[1].pathStride];
+                else if(ok && control) ok = cvOption.calcPayoffsBlock(blocks,&cvPayoffs[j0]);
+                if(ok && antithetic){
+                    // replay the same draws negated and average each pair
+                    vector<double> payoffs1(width);
+                    ok = rnMarket.simulateCorrelatedBlock(config,blocks,gen1,-1) &&
+                    option.calcPayoffsBlock(blocks,&payoffs1[0]);
+                    for(int j=0; j<width; j++) payoffs[j0+j] = (payoffs[j0+j]+payoffs1[j])/2;
+                }
+                if(!ok) evaluated = false;
+            },config.numThreads);
+            if(evaluated){
+                TRACE_SPAN("MultiStockMonteCarloPricer:reduction");
+                if(control) applyControlVariate(payoffs,cvPayoffs,cvMean);
+                double sum = 0, sum2 = 0;
+                for(double V:payoffs){sum += V; sum2 += V*V;}
+                double mean = sum/numSim, var = max((sum2-sum*mean)/(numSim-1),0.);
+                price = exp(-r*T)*mean;
+                err = exp(-r*T)*sqrt(var/numSim);
+            }else{
+                simPriceMatrixSet = rnMarket.simulateCorrelatedPrices(config,numSim);
+                matrix payoffs = option.calcPayoffs(NULL_VECTOR,NULL_MATRIX,simPriceMatrixSet);
+                price = exp(-r*T)*payoffs.mean();
+                err = exp(-r*T)*payoffs.stdev()/sqrt(numSim);
+            }
         }
-    }else if(method=="antithetic variates"){} // TO DO
-    else if(method=="control variates"){} // TO DO
+    }
     tmp = {err};
-    logMessage("ending calculation MonteCarloPricer, return "+to_string(price)+" with error "+to_string(err));
+    logMessage(LOG_DEBUG,"ending calculation MonteCarloPricer, return {} with error {}",price,err);
     return price;
 }
 
 double Pricer::NumIntegrationPricer(double z, double dz){
-    logMessage("starting calculation NumIntegrationPricer on z "+to_string(z)+", dz "+to_string(dz));
+    TRACE_SPAN("NumIntegrationPricer");
+    logMessage(LOG_DEBUG,"starting calculation NumIntegrationPricer on z {}, dz {}",z,dz);
     Stock stock = market.getStock();
-    double r = getVariable("riskFreeRate");
-    double q = getVariable("dividendYield");
-    double T = getVariable("maturity");
+    double r = getVariable(RISK_FREE_RATE);
+    double q = getVariable(DIVIDEND_YIELD);
+    double T = getVariable(MATURITY);
     stock.setDriftRate(r-q);
     int n = static_cast<int>(z/dz);
     matrix z0; z0.setRange(-z,z,2*n);
@@ -355,32 +987,43 @@ double Pricer::NumIntegrationPricer(double z, double dz){
         matrix probs = z0.apply(stdNormalPDF)*dz;
         price = exp(-r*T)*(probs*payoffs).sum();
     }
-    logMessage("ending calculation NumIntegrationPricer, return "+to_string(price));
+    logMessage(LOG_DEBUG,"ending calculation NumIntegrationPricer, return {}",price);
     return price;
 }
 
 double Pricer::BlackScholesPDESolver(const SimulationConfig& config, int numSpace, string method){
-    logMessage("starting calculation BlackScholesPDESolver on config "+to_string(config)+
-               ", numSpace "+to_string(numSpace)+", method "+method);
-    double S0 = getVariable("currentPrice");
-    double x = log(S0);
-    vector<matrix> fullCalc = BlackScholesPDESolverWithFullCalc(config,numSpace,method);
-    matrix spaceGrids = fullCalc[0];
-    matrix priceMatrix = fullCalc[2];
-    vector<int> idx = spaceGrids.find(x,"closest");
-    price = priceMatrix.getEntry(idx);
-    logMessage("ending calculation BlackScholesPDESolver, return "+to_string(price));
+    logMessage(LOG_DEBUG,"starting calculation BlackScholesPDESolver on config {}, numSpace {}, method {}",
+               config,numSpace,method);
+    double S0 = getVariable(CURRENT_PRICE);
+    price = BlackScholesPDEGrid(config,numSpace,method).calcPrice(S0);
+    logMessage(LOG_DEBUG,"ending calculation BlackScholesPDESolver, return {}",price);
     return price;
 }
 
+PriceGrid Pricer::BlackScholesPDEGrid(const SimulationConfig& config, int numSpace, string method){
+    return PriceGrid(BlackScholesPDESolverWithFullCalc(config,numSpace,method));
+}
+
+Greeks Pricer::BlackScholesPDEGreeks(const SimulationConfig& config, int numSpace, string method){
+    // price, delta, gamma and theta at S0 off one solve
+    logMessage(LOG_DEBUG,"starting calculation BlackScholesPDEGreeks on config {}, numSpace {}, method {}",
+               config,numSpace,method);
+    Greeks greeks = BlackScholesPDEGrid(config,numSpace,method).calcGreeks(getVariable(CURRENT_PRICE));
+    price = greeks.price;
+    logMessage(LOG_DEBUG,"ending calculation BlackScholesPDEGreeks, return price {}, delta {}, gamma {}, theta {}",
+               greeks.price,greeks.delta,greeks.gamma,greeks.theta);
+    return greeks;
+}
+
 vector<matrix> Pricer::BlackScholesPDESolverWithFullCalc(const SimulationConfig& config, int numSpace, string method){
+    TRACE_SPAN_ITEMS("BlackScholesPDESolver","nodes",(config.iters+1.)*(numSpace+1));
     Stock stock = market.getStock();
-    double K = getVariable("strike");
-    double T = getVariable("maturity");
-    double r = getVariable("riskFreeRate");
-    //    double S0 = getVariable("currentPrice");
-    double q = getVariable("dividendYield");
-    double sig = getVariable("volatility");
+    double K = getVariable(STRIKE);
+    double T = getVariable(MATURITY);
+    double r = getVariable(RISK_FREE_RATE);
+    //    double S0 = getVariable(CURRENT_PRICE);
+    double q = getVariable(DIVIDEND_YIELD);
+    double sig = getVariable(VOLATILITY);
     int n = config.iters;
     int m = numSpace;
     double dt = config.stepSize;
@@ -389,7 +1032,7 @@ vector<matrix> Pricer::BlackScholesPDESolverWithFullCalc(const SimulationConfig&
     double sig2 = sig*sig;
     matrix priceMatrix(n+1,m+1);
     matrix spaceGrids, timeGrids; timeGrids.setRange(0,T,n,true);
-    matrix payoffs, bdryCondition0(1,n+1), bdryCondition1(1,n+1), v, u(m-1,1);
+    matrix payoffs, bdryCondition0(1,n+1), bdryCondition1(1,n+1);
     if(option.getType()=="European" || option.getType()=="American"){
         x0 = log(K/3); x1 = log(3*K);
         if(option.getPutCall()=="Call"){
@@ -449,51 +1092,155 @@ vector<matrix> Pricer::BlackScholesPDESolverWithFullCalc(const SimulationConfig&
     priceMatrix.setCol(0,bdryCondition0);
     priceMatrix.setCol(m,bdryCondition1);
     // cout << priceMatrix.print() << endl;
-    v = priceMatrix.submatrix(n,n+1,1,m).T();
-    if(method=="implicit"){
-        double a = +(r-q-sig2/2)*dt/(2*dx)-sig2/2*dt/dx2;
-        double b = 1+r*dt+sig2*dt/dx2;
-        double c = -(r-q-sig2/2)*dt/(2*dx)-sig2/2*dt/dx2;
-        matrix D(m-1,m-1);
-        D.setDiags({a,b,c},{-1,0,1});
-        D = D.inverse(); // TO DO: eff sparse inverse
-        for(int i=n-1; i>=0; i--){
-            double u0 = a*priceMatrix.getEntry(i,0);
-            double u1 = c*priceMatrix.getEntry(i,m);
-            u.setEntry(0,0,u0);
-            u.setEntry(m-2,0,u1);
-            v = D.dot(v-u);
-            if(option.canEarlyExercise()) v = max(payoffs.submatrix(1,-2,"col").T(),v);
-            priceMatrix.setSubmatrix(i,i+1,1,m,v.T());
-        }
-    }else if(method=="explicit"){
-        double a = -(r-q-sig2/2)*dt/(2*dx)+sig2/2*dt/dx2;
-        double b = 1-r*dt-sig2*dt/dx2;
-        double c = +(r-q-sig2/2)*dt/(2*dx)+sig2/2*dt/dx2;
-        matrix D(m-1,m-1);
-        D.setDiags({a,b,c},{-1,0,1});
+    vector<double> exercise = payoffs.getRowVector(0), v(exercise.begin()+1,exercise.end()-1);
+    if(method=="implicit" || method=="explicit"){
+        // implicit: D*v(i) = v(i+1)-u(i) with the boundary values u at step i, explicit: v(i) = D*v(i+1)+u(i+1)
+        double sgn = (method=="implicit")?1:-1;
+        double a = sgn*((r-q-sig2/2)*dt/(2*dx)-sig2/2*dt/dx2);
+        double b = 1+sgn*(r*dt+sig2*dt/dx2);
+        double c = sgn*(-(r-q-sig2/2)*dt/(2*dx)-sig2/2*dt/dx2);
+        vector<double> factors;
+        TRACE_SPAN("BlackScholesPDESolver:linearSolve");
         for(int i=n-1; i>=0; i--){
-            double u0 = a*priceMatrix.getEntry(i+1,0);
-            double u1 = c*priceMatrix.getEntry(i+1,m);
-            u.setEntry(0,0,u0);
-            u.setEntry(m-2,0,u1);
-            v = D.dot(v)+u;
-            if(option.canEarlyExercise()) v = max(payoffs.submatrix(1,-2,"col").T(),v);
-            priceMatrix.setSubmatrix(i,i+1,1,m,v.T());
+            int k = (method=="implicit")?i:i+1;
+            _BlackScholesPDEStep(v,a,b,c,a*priceMatrix.getEntry(k,0),c*priceMatrix.getEntry(k,m),method,factors);
+            if(option.canEarlyExercise()) for(int j=0; j<m-1; j++) v[j] = max(exercise[j+1],v[j]);
+            for(int j=0; j<m-1; j++) priceMatrix.setEntry(i,j+1,v[j]);
         }
     }
     // cout << priceMatrix.print() << endl;
     return {spaceGrids, timeGrids, priceMatrix};
 }
 
+PriceGrid::PriceGrid(const vector<matrix>& fullCalc){
+    if(fullCalc.size()<3) return;
+    spaceGrids = fullCalc[0];
+    timeGrids = fullCalc[1];
+    priceMatrix = fullCalc[2];
+}
+
+double PriceGrid::calcPrice(double S, double t) const {
+    return calcGreeks(S,t).price;
+}
+
+Greeks PriceGrid::calcGreeks(double S, double t) const {
+    // quadratic in log price through the node closest to S and its neighbours, linear in time between the
+    // rows around t; theta is the difference of those rows, vega and rho are not on the grid
+    Greeks greeks = NULL_GREEKS;
+    int m = spaceGrids.getCols()-1, n = timeGrids.getCols()-1;
+    if(isEmpty() || m<2 || n<1) return greeks;
+    double x0 = spaceGrids.getEntry(0,0), dx = (spaceGrids.getEntry(0,m)-x0)/m;
+    double t0 = timeGrids.getEntry(0,0), dt = (timeGrids.getEntry(0,n)-t0)/n;
+    double y = (log(S)-x0)/dx, s = (t-t0)/dt;
+    int j = max(1,min(m-1,(int)floor(y+.5))), i = max(0,min(n-1,(int)floor(s)));
+    double z = y-j; s -= i;
+    double V[2], Vx[2], Vxx[2];
+    for(int k=0; k<2; k++){
+        double v0 = priceMatrix.getEntry(i+k,j-1), v1 = priceMatrix.getEntry(i+k,j), v2 = priceMatrix.getEntry(i+k,j+1);
+        double first = (v2-v0)/2, second = v2-2*v1+v0;
+        V[k] = v1+z*first+z*z*second/2;
+        Vx[k] = (first+z*second)/dx;
+        Vxx[k] = second/(dx*dx);
+    }
+    double Vx_ = (1-s)*Vx[0]+s*Vx[1], Vxx_ = (1-s)*Vxx[0]+s*Vxx[1];
+    greeks.price = (1-s)*V[0]+s*V[1];
+    greeks.delta = Vx_/S;
+    greeks.gamma = (Vxx_-Vx_)/(S*S);
+    greeks.theta = (V[1]-V[0])/dt;
+    return greeks;
+}
+
+template <class R>
+void Pricer::_BlackScholesPDEStep(vector<R>& v, const R& a, const R& b, const R& c,
+                                  const R& u0, const R& u1, string method, vector<R>& factors){
+    // one time step on the interior nodes of the tridiagonal D = (a,b,c), u0 and u1 carry the boundaries;
+    // implicit steps solve D by the Thomas algorithm in O(m), its factors are computed on the first step
+    int m = (int)v.size();
+    if(m==0) return;
+    if(method=="implicit"){
+        // factors: the reciprocal pivots in [0,m), the eliminated superdiagonal in [m,2m)
+        if((int)factors.size()!=2*m){
+            factors.resize(2*m);
+            R pivot = b;
+            for(int j=0; j<m; j++){
+                if(j>0) pivot = b-a*factors[m+j-1];
+                factors[j] = 1/pivot;
+                factors[m+j] = c*factors[j];
+            }
+        }
+        v[0] -= u0; v[m-1] -= u1;
+        v[0] *= factors[0];
+        for(int j=1; j<m; j++) v[j] = (v[j]-a*v[j-1])*factors[j];
+        for(int j=m-2; j>=0; j--) v[j] -= factors[m+j]*v[j+1];
+    }else if(method=="explicit"){
+        R prev = 0; // v(j-1) before the update
+        for(int j=0; j<m; j++){
+            R x = b*v[j];
+            if(j>0) x = a*prev+x;
+            if(j<m-1) x += c*v[j+1];
+            prev = v[j];
+            v[j] = x;
+        }
+        v[0] += u0; v[m-1] += u1;
+    }
+}
+
+template <class R>
+R Pricer::_BlackScholesPDEValue(const SimulationConfig& config, int numSpace, string method,
+                                const PricingInputs<R>& in){
+    // European, American and Digital on the log-price grid of BlackScholesPDESolverWithFullCalc with n steps
+    // of in.T/n, R is double or an AD scalar; the value is interpolated in log(S0), so that it stays
+    // differentiable in S0
+    OptionType type = option.getTypeId();
+    if((type!=EUROPEAN && type!=AMERICAN && type!=DIGITAL) || option.getPutCallId()==NO_PUT_CALL || numSpace<4) return NAN;
+    const R &K = in.K, &T = in.T, &r = in.r, &q = in.q, &sig = in.sig;
+    int n = config.iters, m = numSpace;
+    double w = (option.getPutCallId()==CALL)?1:-1;
+    R dt = T/n, sig2 = sig*sig;
+    R x0 = log(K/3), x1 = log(3*K);
+    R dx = (x1-x0)/m, dx2 = dx*dx;
+    auto bdry = [&](const R& S, const R& tau){
+        // boundary values of BlackScholesPDESolverWithFullCalc at S with time tau to maturity, zero out of the money
+        if(w*(S-K)<=0) return R(0.);
+        if(type==DIGITAL) return R(exp(-r*tau));
+        return (w>0)?R(S*exp(-q*tau)-K*exp(-r*tau)):R(K*exp(-r*tau));
+    };
+    vector<R> exercise(m-1), v(m-1);
+    for(int j=0; j<m-1; j++){
+        R S = exp(x0+(j+1)*dx);
+        if(type==DIGITAL) exercise[j] = (w*(S-K)>0)?1.:0.;
+        else exercise[j] = max(R(w*(S-K)),R(0.));
+    }
+    v = exercise;
+    double sgn = (method=="implicit")?1:-1;
+    if(method!="implicit" && method!="explicit") return NAN;
+    R a = sgn*((r-q-sig2/2)*dt/(2*dx)-sig2/2*dt/dx2);
+    R b = 1+sgn*(r*dt+sig2*dt/dx2);
+    R c = sgn*(-(r-q-sig2/2)*dt/(2*dx)-sig2/2*dt/dx2);
+    R S0 = exp(x0), S1 = exp(x1);
+    vector<R> factors;
+    for(int i=n-1; i>=0; i--){
+        R tau = (method=="implicit")?T-i*dt:T-(i+1)*dt;
+        _BlackScholesPDEStep(v,a,b,c,R(a*bdry(S0,tau)),R(c*bdry(S1,tau)),method,factors);
+        if(type==AMERICAN) for(int j=0; j<m-1; j++) v[j] = max(exercise[j],v[j]);
+    }
+    // quadratic through the node closest to log(S0) and its neighbours, its slope at the node is the
+    // central difference, also where the payoff kink sits on the node
+    R x = log(in.S0);
+    int j = (int)floor(primal((x-x0)/dx)+.5)-1; // interior index of the closest node
+    j = max(1,min(m-3,j));
+    R t = (x-x0)/dx-(j+1);
+    return v[j]+t*(v[j+1]-v[j-1])/2+t*t*(v[j+1]-2*v[j]+v[j-1])/2;
+}
+
 vector<double> Pricer::_FourierInversionPricer(const function<complx(complx)>& charFunc, int numSpace, double rightLim, string method){
     int m = numSpace;
     double x1 = rightLim;
-    double K = getVariable("strike");
-    double T = getVariable("maturity");
-    double r = getVariable("riskFreeRate");
-    double S0 = getVariable("currentPrice");
-    double q = getVariable("dividendYield");
+    double K = getVariable(STRIKE);
+    double T = getVariable(MATURITY);
+    double r = getVariable(RISK_FREE_RATE);
+    double S0 = getVariable(CURRENT_PRICE);
+    double q = getVariable(DIVIDEND_YIELD);
     double k = log(S0/K)+(r-q)*T; // forward log moneyness
     double x0 = 1e-5;
     double du = (x1-x0)/m;
@@ -546,11 +1293,11 @@ vector<double> Pricer::_FourierInversionPricer(const function<complx(complx)>& c
 vector<matrix> Pricer::_fastFourierInversionPricer(const function<complx(complx)>& charFunc, int numSpace, double rightLim){
     int m = pow(2,ceil(log(numSpace)/log(2)));
     double x1 = rightLim;
-//    double K = getVariable("strike");
-    double T = getVariable("maturity");
-//    double r = getVariable("riskFreeRate");
-    double S0 = getVariable("currentPrice");
-    double q = getVariable("dividendYield");
+//    double K = getVariable(STRIKE);
+    double T = getVariable(MATURITY);
+//    double r = getVariable(RISK_FREE_RATE);
+    double S0 = getVariable(CURRENT_PRICE);
+    double q = getVariable(DIVIDEND_YIELD);
     double du = x1/m;
     double dk = 2*M_PI/x1;
     double b = m*dk/2;
@@ -561,7 +1308,10 @@ vector<matrix> Pricer::_fastFourierInversionPricer(const function<complx(complx)
         double w = (n==0||n==m-1)?1:(n%2?4:2);
         F[n] = w/3*exp(-i*b*n*du)*charFunc(u-i/2)/(u*u+.25);
     }
-    fft(F);
+    {
+        TRACE_SPAN("FourierInversionPricer:fft");
+        fft(F);
+    }
     if(USE_LOOP){
         lwCalls = matrix(1,m);
         double mult0 = S0*exp(-q*T);
@@ -577,14 +1327,15 @@ vector<matrix> Pricer::_fastFourierInversionPricer(const function<complx(complx)
 }
 
 double Pricer::FourierInversionPricer(int numSpace, double rightLim, string method){
-    logMessage("starting calculation FourierInversionPricer on config numSpace "+
-               to_string(numSpace)+", rightLim "+to_string(rightLim)+", method "+method);
+    TRACE_SPAN("FourierInversionPricer");
+    logMessage(LOG_DEBUG,"starting calculation FourierInversionPricer on config numSpace {}, rightLim {}, method {}",
+               numSpace,rightLim,method);
     Stock stock = market.getStock();
-    double K = getVariable("strike");
-    double T = getVariable("maturity");
-    double r = getVariable("riskFreeRate");
-    double S0 = getVariable("currentPrice");
-    double q = getVariable("dividendYield");
+    double K = getVariable(STRIKE);
+    double T = getVariable(MATURITY);
+    double r = getVariable(RISK_FREE_RATE);
+    double S0 = getVariable(CURRENT_PRICE);
+    double q = getVariable(DIVIDEND_YIELD);
     stock.setDriftRate(r-q);
     function<complx(complx)> charFunc;
     string dynamics = stock.getDynamics();
@@ -641,17 +1392,72 @@ double Pricer::FourierInversionPricer(int numSpace, double rightLim, string meth
             else if(option.getPutCall()=="Put") price = lwCall-S0*exp(-q*T)+K*exp(-r*T);
         }
     }
-    logMessage("ending calculation FourierInversionPricer, return "+to_string(price));
+    logMessage(LOG_DEBUG,"ending calculation FourierInversionPricer, return {}",price);
     return price;
 }
 
+string Pricer::_cacheKey(string calc, const SimulationConfig& config, int numSim, int numSpace, double eps) const {
+    // every input an engine reads: option spec, market, config except numThreads (engines are reproducible
+    // whatever the thread count), path and grid sizes; the option name is left out
+    CacheKey key;
+    key.add(calc).add(option.getType()).add(option.getPutCall()).add(option.getStrike()).add(option.getMaturity());
+    key.add(option.getParams()).add(option.getNature());
+    key.add(market.getRiskFreeRate()).add(market.getCorMatrix());
+    for(int i=-1; i<(int)market.getStocks().size(); i++){
+        const Stock& stock = market.getStock(i);
+        key.add(stock.getDynamics()).add(stock.getCurrentPrice()).add(stock.getDividendYield());
+        key.add(stock.getDriftRate()).add(stock.getVolatility()).add(stock.getDynParams());
+    }
+    key.add(config.iters).add(config.endTime).add(config.stepSize).add(config.pathLayout).add(config.tilePaths);
+    key.add((long long)config.seed).add(config.barrierCorrection).add(config.lsmBasis).add(config.lsmDegree);
+    key.add(config.lsmBoundPaths).add(config.lsmInnerPaths).add((int)config.simGreeks);
+    key.add(numSim).add(numSpace).add(eps);
+    return key.bytes;
+}
+
+bool Pricer::_isReproducible(const SimulationConfig& config) const {
+    // Monte Carlo replays its paths for a seed only on the seeded kernels: Stock::simulatePriceBlock for a
+    // single stock (lognormal, Heston) and Market::simulateCorrelatedBlock for multi-stock options (also
+    // jump-diffusion); the other dynamics draw from the unseeded global generator
+    if(config.seed==0) return false;
+    if(!option.isMultiStock()){
+        string dynamics = market.getStock().getDynamics();
+        return dynamics=="lognormal" || dynamics=="Heston";
+    }
+    for(auto& stock:market.getStocks()){
+        string dynamics = stock.getDynamics();
+        if(dynamics!="lognormal" && dynamics!="jump-diffusion" && dynamics!="Heston") return false;
+    }
+    return true;
+}
+
 double Pricer::calcPrice(string method, const SimulationConfig& config, int numSim, int numSpace){
+    // with a cache, engines that give the same price for the same inputs are looked up first; Monte Carlo
+    // only when reproducible and not estimating greeks on its paths, with its error and bounds in tmp
+    bool cached = cache && !(method=="Monte Carlo" && (!_isReproducible(config) || config.simGreeks));
+    string key;
+    if(cached){
+        key = _cacheKey("price "+method,config,numSim,numSpace);
+        vector<double> value;
+        if(cache->lookup(key,value)){
+            if(method=="Monte Carlo") tmp.assign(value.begin()+1,value.end());
+            return price = value[0];
+        }
+    }
     if(method=="Closed Form"){
         price = BlackScholesClosedForm();
     }else if(method=="Binomial Tree"){
         price = BinomialTreePricer(config);
+    }else if(method=="Binomial Tree LR"){
+        price = BinomialTreePricer(config,"LR");
+    }else if(method=="Binomial Tree LRR"){
+        price = BinomialTreePricer(config,"LRR");
+    }else if(method=="Binomial Tree BBS"){
+        price = BinomialTreePricer(config,"BBS");
+    }else if(method=="Binomial Tree BBSR"){
+        price = BinomialTreePricer(config,"BBSR");
     }else if(method=="Monte Carlo"){
-        price = MonteCarloPricer(config,numSim);
+        price = option.isMultiStock()?MultiStockMonteCarloPricer(config,numSim):MonteCarloPricer(config,numSim);
     }else if(method=="Num Integration"){
         price = NumIntegrationPricer();
     }else if(method=="PDE Solver"){
@@ -659,97 +1465,191 @@ double Pricer::calcPrice(string method, const SimulationConfig& config, int numS
     }else if(method=="Fourier Inversion"){
         price = FourierInversionPricer(numSpace);
     }
+    if(cached){
+        vector<double> value{price};
+        if(method=="Monte Carlo") value.insert(value.end(),tmp.begin(),tmp.end());
+        cache->insert(key,value);
+    }
     return price;
 }
 
+template <class R>
+R Pricer::_calcPrice(string method, const SimulationConfig& config, int numSpace, const PricingInputs<R>& in){
+    // the engines of calcPrice that are written for any scalar type R
+    if(method=="Closed Form") return BlackScholesFormula(option.getTypeId(),option.getPutCallId(),in);
+    else if(method=="Binomial Tree") return _BinomialTreeValue(config,"CRR",in);
+    else if(method=="Binomial Tree LR") return _BinomialTreeValue(config,"LR",in);
+    else if(method=="Binomial Tree LRR") return _BinomialTreeValue(config,"LRR",in);
+    else if(method=="Binomial Tree BBS") return _BinomialTreeValue(config,"BBS",in);
+    else if(method=="Binomial Tree BBSR") return _BinomialTreeValue(config,"BBSR",in);
+    else if(method=="PDE Solver") return _BlackScholesPDEValue(config,numSpace,"implicit",in);
+    return NAN;
+}
+
+vector<double> Pricer::calcPriceGradient(string method, string mode, const SimulationConfig& config, int numSpace){
+    // price followed by its derivatives in AD_VARIABLES from one differentiated run of the engine:
+    // "Forward" carries all six derivatives along with every value, "Adjoint" records the run on the
+    // thread's tape and sweeps it back once; the lattice horizon config.iters*config.stepSize stands
+    // for the maturity of the binomial trees, as in BinomialTreePricer. The CRR price is piecewise linear
+    // in S0 and K and is differentiated on its current piece, BBS and LR smooth the kink at the strike
+    logMessage(LOG_DEBUG,"starting calculation calcPriceGradient on method {}, mode {}, config {}, numSpace {}",
+               method,mode,config,numSpace);
+    PricingInputs<double> in = getPricingInputs();
+    if(method.find("Binomial Tree")==0) in.T = config.iters*config.stepSize;
+    int numInputs = (int)AD_VARIABLES.size();
+    vector<double> gradient(1+numInputs,NAN);
+    if(mode=="Forward"){
+        typedef dual<6> fdouble;
+        PricingInputs<fdouble> x = {fdouble(in.S0,0),fdouble(in.K,1),fdouble(in.T,2),
+                                    fdouble(in.r,3),fdouble(in.q,4),fdouble(in.sig,5)};
+        fdouble v = _calcPrice(method,config,numSpace,x);
+        gradient[0] = v.getValue();
+        for(int k=0; k<numInputs; k++) gradient[1+k] = v.getDeriv(k);
+    }else if(mode=="Adjoint"){
+        ADTape& tape = ADTape::active();
+        tape.clear();
+        PricingInputs<adouble> x = {adouble::variable(in.S0),adouble::variable(in.K),adouble::variable(in.T),
+                                    adouble::variable(in.r),adouble::variable(in.q),adouble::variable(in.sig)};
+        adouble v = _calcPrice(method,config,numSpace,x);
+        vector<double> adj = tape.adjoint(v.getNode());
+        gradient[0] = v.getValue();
+        int k = 1;
+        for(auto xk:{x.S0,x.K,x.T,x.r,x.q,x.sig}) gradient[k++] = (xk.getNode()<(int)adj.size())?adj[xk.getNode()]:0;
+        tape.clear();
+    }
+    if(isnan(gradient[0])) fill(gradient.begin(),gradient.end(),NAN);
+    price = gradient[0];
+    logMessage(LOG_DEBUG,"ending calculation calcPriceGradient, return {}",gradient);
+    return gradient;
+}
+
+void Pricer::_forEachPoint(int numPoints, const function<void(Pricer&,int)>& f, int numThreads) const {
+    // f(pricer,k) for k<numPoints in contiguous chunks, each chunk on its own copy of this pricer so that
+    // points set their variables freely; a threaded engine (Monte Carlo) should be given numThreads=1
+    if(numThreads<=0) numThreads = numHardwareThreads();
+    int numChunks = min(numPoints,4*numThreads);
+    parallelFor(numChunks,[&](int c){
+        Pricer pricer(*this);
+        for(int k=(int)((long)numPoints*c/numChunks); k<(int)((long)numPoints*(c+1)/numChunks); k++) f(pricer,k);
+    },numThreads);
+}
+
 matrix Pricer::varyPriceWithVariable(string var, const matrix& varVector,
                                      string method, const SimulationConfig& config, int numSim){
-    saveAsOriginal();
+    // points in parallel, numSim is also the numSpace of the grid engines; PDE prices in the current price
+    // are read off one solve, the grid does not depend on it
+    PricerVariable varId = parseVariable(var);
     int n = varVector.getCols();
     matrix optionPriceVector(1,n);
-    for(int i=0; i<n; i++){
-        double v = varVector.getEntry(0,i);
-        setVariable(var,v);
-        price = calcPrice(method,config,numSim);
-        optionPriceVector.setEntry(0,i,price);
+    if(method=="PDE Solver" && varId==CURRENT_PRICE){
+        PriceGrid grid = BlackScholesPDEGrid(config,numSim);
+        for(int i=0; i<n; i++) optionPriceVector.setEntry(0,i,grid.calcPrice(varVector.getEntry(0,i)));
+        return optionPriceVector;
     }
-    resetOriginal();
+    _forEachPoint(n,[&](Pricer& pricer, int i){
+        pricer.setVariable(varId,varVector.getEntry(0,i));
+        optionPriceVector.setEntry(0,i,pricer.calcPrice(method,config,numSim,numSim));
+    },(method=="Monte Carlo")?1:config.numThreads);
     return optionPriceVector;
 }
 
+Greeks Pricer::BlackScholesGreeks(OptionType type, PutCall putCall,
+                                  double S0, double K, double T, double r, double q, double sig){
+    // every greek is built from the same d1, d2, densities and discount factors
+    Greeks g = NULL_GREEKS;
+    if((type!=EUROPEAN && type!=DIGITAL) || putCall==NO_PUT_CALL) return g;
+    double w = (putCall==CALL)?1:-1;
+    double sqrt_T = sqrt(T), sigT = sig*sqrt_T;
+    double d1 = (log(S0/K)+(r-q+sig*sig/2)*T)/sigT;
+    double d2 = d1-sigT;
+    double discR = exp(-r*T), discQ = exp(-q*T);
+    double Nd1 = normalCDF(w*d1), Nd2 = normalCDF(w*d2);
+    double dd2_dT = (r-q-sig*sig/2)/sigT-d2/(2*T); // time derivative of d2
+    if(type==EUROPEAN){
+        double n1 = normalPDF(d1);
+        g.price = w*(S0*discQ*Nd1-K*discR*Nd2);
+        g.delta = w*discQ*Nd1;
+        g.gamma = discQ*n1/(S0*sigT);
+        g.vega  = S0*discQ*n1*sqrt_T;
+        g.rho   = w*K*T*discR*Nd2;
+        g.theta = -S0*discQ*n1*sig/(2*sqrt_T)+w*(q*S0*discQ*Nd1-r*K*discR*Nd2);
+        g.vanna = -discQ*n1*d2/sig;
+        g.volga = g.vega*d1*d2/sig;
+        g.charm = w*q*discQ*Nd1-discQ*n1*(dd2_dT+sig/(2*sqrt_T));
+    }else{
+        // cash-or-nothing, pays one
+        double n2 = normalPDF(d2);
+        g.price = discR*Nd2;
+        g.delta = w*discR*n2/(S0*sigT);
+        g.gamma = -w*discR*n2*d1/(S0*S0*sigT*sigT);
+        g.vega  = -w*discR*n2*d1/sig;
+        g.rho   = -T*g.price+w*discR*n2*sqrt_T/sig;
+        g.theta = r*g.price-w*discR*n2*dd2_dT;
+        g.vanna = w*discR*n2*(d1*d2-1)/(S0*sig*sigT);
+        g.volga = -w*discR*n2*(d1*d1*d2-d1-d2)/(sig*sig);
+        g.charm = g.delta*(r+d2*dd2_dT+1/(2*T));
+    }
+    return g;
+}
+
+Greeks Pricer::ClosedFormGreeks() const {
+    double T = getVariable(MATURITY);
+    if(T==0) T = 1e-5;
+    return BlackScholesGreeks(option.getTypeId(),option.getPutCallId(),
+                              getVariable(CURRENT_PRICE),getVariable(STRIKE),T,getVariable(RISK_FREE_RATE),
+                              getVariable(DIVIDEND_YIELD),getVariable(VOLATILITY));
+}
+
 double Pricer::ClosedFormGreek(string var, int derivOrder){
-    logMessage("starting calculation ClosedFormGreek on var "+var+", derivOrder "+to_string(derivOrder));
-    saveAsOriginal();
+    logMessage(LOG_DEBUG,"starting calculation ClosedFormGreek on var {}, derivOrder {}",var,derivOrder);
     double greek = NAN;
-    if(option.getType()=="European"){
-        if(getVariable("maturity")==0)
-            setVariable("maturity",1e-5);
-        double K   = getVariable("strike");
-        double T   = getVariable("maturity");
-        double r   = getVariable("riskFreeRate");
-        double S0  = getVariable("currentPrice");
-        double q   = getVariable("dividendYield");
-        double sig = getVariable("volatility");
-        double sqrt_T = sqrt(T);
-        double d1  = (log(S0/K)+(r-q+sig*sig/2)*T)/(sig*sqrt_T);
-        double d2  = d1-sig*sqrt_T;
-        if(option.getPutCall()=="Call"){
-            if(var=="currentPrice" && derivOrder==1)
-                greek = normalCDF(d1);
-            else if(var=="currentPrice" && derivOrder==2)
-                greek = normalPDF(d1)/(S0*sig*sqrt_T);
-            else if(var=="volatility" && derivOrder==1)
-                greek = S0*normalPDF(d1)*sqrt_T;
-            else if(var=="riskFreeRate" && derivOrder==1)
-                greek = K*T*exp(-r*T)*normalCDF(d2);
-            else if(var=="time" && derivOrder==1)
-                greek = -S0*normalPDF(d1)*sig/(2*sqrt_T)-r*K*exp(-r*T)*normalCDF(d2);
-        }else if(option.getPutCall()=="Put"){
-            if(var=="currentPrice" && derivOrder==1)
-                greek = normalCDF(d1)-1;
-            else if(var=="currentPrice" && derivOrder==2)
-                greek = normalPDF(d1)/(S0*sig*sqrt_T);
-            else if(var=="volatility" && derivOrder==1)
-                greek = S0*normalPDF(d1)*sqrt_T;
-            else if(var=="riskFreeRate" && derivOrder==1)
-                greek = -K*T*exp(-r*T)*normalCDF(-d2);
-            else if(var=="time" && derivOrder==1)
-                greek = -S0*normalPDF(d1)*sig/(2*sqrt_T)+r*K*exp(-r*T)*normalCDF(-d2);
-        }
-    }else if(option.getType()=="Digital"){}
-    resetOriginal();
-    logMessage("ending calculation ClosedFormGreek, return "+to_string(greek));
+    Greeks g = ClosedFormGreeks();
+    if(var=="currentPrice" && derivOrder==1) greek = g.delta;
+    else if(var=="currentPrice" && derivOrder==2) greek = g.gamma;
+    else if(var=="volatility" && derivOrder==1) greek = g.vega;
+    else if(var=="riskFreeRate" && derivOrder==1) greek = g.rho;
+    else if(var=="time" && derivOrder==1) greek = g.theta;
+    logMessage(LOG_DEBUG,"ending calculation ClosedFormGreek, return {}",greek);
     return greek;
 }
 
 double Pricer::FiniteDifferenceGreek(string var, int derivOrder, string method,
                                      const SimulationConfig& config, int numSim, double eps){
-    logMessage("starting calculation FiniteDifferenceGreek on var "+var+", derivOrder "+to_string(derivOrder)+
-               ", method "+method+", config "+to_string(config)+", numSim "+to_string(numSim)+", eps "+to_string(eps));
+    logMessage(LOG_DEBUG,"starting calculation FiniteDifferenceGreek on var {}, derivOrder {}, method {}, config {}, numSim {}, eps {}",
+               var,derivOrder,method,config,numSim,eps);
     saveAsOriginal();
     double greek = NAN;
     double v,dv,v_pos,v_neg,price_pos,price_neg;
-    v = getVariable(var);
+    PricerVariable varId = parseVariable(var);
+    v = getVariable(varId);
     dv = v*eps;
     v_pos = v+dv;
     v_neg = v-dv;
     price = calcPrice(method,config,numSim);
-    setVariable(var,v_pos);
+    setVariable(varId,v_pos);
     price_pos = calcPrice(method,config,numSim);
-    setVariable(var,v_neg);
+    setVariable(varId,v_neg);
     price_neg = calcPrice(method,config,numSim);
     switch(derivOrder){
         case 1: greek = (price_pos-price_neg)/(2*dv); break;
         case 2: greek = (price_pos-2*price+price_neg)/(dv*dv); break;
     }
     resetOriginal();
-    logMessage("ending calculation FiniteDifferenceGreek, return "+to_string(greek));
+    logMessage(LOG_DEBUG,"ending calculation FiniteDifferenceGreek, return {}",greek);
     return greek;
 }
 
 double Pricer::calcGreek(string greekName, string greekMethod, string method,
                          const SimulationConfig& config, int numSim, double eps){
     double greek = NAN;
+    // Simulation greeks always come from Monte Carlo paths, the other methods only on a Monte Carlo price
+    bool simulated = greekMethod=="Simulation" || (method=="Monte Carlo" && greekMethod!="Closed Form");
+    bool cached = cache && !(simulated && !_isReproducible(config));
+    string key;
+    if(cached){
+        key = _cacheKey("greek "+greekName+" "+greekMethod+" "+method,config,numSim,0,eps);
+        if(cache->lookup(key,greek)) return greek;
+    }
     string var; int derivOrder;
     if(greekName=="Delta"){
         var = "currentPrice";
@@ -771,49 +1671,177 @@ double Pricer::calcGreek(string greekName, string greekMethod, string method,
         greek = ClosedFormGreek(var,derivOrder);
     else if(greekMethod=="Finite Difference")
         greek = FiniteDifferenceGreek(var,derivOrder,method,config,numSim,eps);
+    else if(greekMethod=="Simulation" || greekMethod=="PDE Grid" || greekMethod=="Algorithmic Differentiation"){
+        Greeks greeks = calcGreeks(greekMethod,method,config,numSim,eps);
+        if(greekName=="Delta") greek = greeks.delta;
+        else if(greekName=="Gamma") greek = greeks.gamma;
+        else if(greekName=="Vega") greek = greeks.vega;
+        else if(greekName=="Rho") greek = greeks.rho;
+        else if(greekName=="Theta") greek = greeks.theta;
+    }
+    if(cached) cache->insert(key,greek);
     return greek;
 }
 
+Greeks Pricer::calcGreeks(string greekMethod, string method,
+                          const SimulationConfig& config, int numSim, double eps){
+    logMessage(LOG_DEBUG,"starting calculation calcGreeks on greekMethod {}, method {}",greekMethod,method);
+    Greeks greeks = NULL_GREEKS;
+    if(greekMethod=="Closed Form")
+        greeks = ClosedFormGreeks();
+    else if(greekMethod=="Finite Difference"){
+        greeks.price = calcPrice(method,config,numSim);
+        greeks.delta = FiniteDifferenceGreek("currentPrice",1,method,config,numSim,eps);
+        greeks.gamma = FiniteDifferenceGreek("currentPrice",2,method,config,numSim,eps);
+        greeks.vega  = FiniteDifferenceGreek("volatility",1,method,config,numSim,eps);
+        greeks.rho   = FiniteDifferenceGreek("riskFreeRate",1,method,config,numSim,eps);
+        greeks.theta = -FiniteDifferenceGreek("maturity",1,method,config,numSim,eps);
+    }else if(greekMethod=="Simulation"){
+        // estimated on the paths of a single Monte Carlo pricing run
+        SimulationConfig simConfig = config;
+        simConfig.simGreeks = true;
+        MonteCarloPricer(simConfig,numSim);
+        greeks = simGreeks;
+    }else if(greekMethod=="PDE Grid"){
+        // one solve of the PDE, numSim doubles as the number of space nodes
+        greeks = BlackScholesPDEGreeks(config,numSim);
+    }else if(greekMethod=="Algorithmic Differentiation"){
+        // first order only, from one adjoint sweep; numSim doubles as the number of space nodes of the PDE
+        vector<double> gradient = calcPriceGradient(method,"Adjoint",config,numSim);
+        greeks.price = gradient[0];
+        greeks.delta = gradient[1];
+        greeks.theta = -gradient[3];
+        greeks.rho   = gradient[4];
+        greeks.vega  = gradient[6];
+    }
+    logMessage(LOG_DEBUG,"ending calculation calcGreeks, return price {}, delta {}, gamma {}, vega {}, rho {}, theta {}",
+               greeks.price,greeks.delta,greeks.gamma,greeks.vega,greeks.rho,greeks.theta);
+    return greeks;
+}
+
+vector<RiskBump> Pricer::getRiskLadder() const {
+    // delta, gamma and vega of every stock, rho, and the first order in every correlation
+    vector<RiskBump> ladder;
+    int m = (int)market.getStocks().size();
+    for(int i=(m>0?0:-1); i<max(m,0); i++){ // -1 is the single stock
+        ladder.push_back(RiskBump(CURRENT_PRICE,1,1e-2,i));
+        ladder.push_back(RiskBump(CURRENT_PRICE,2,1e-2,i));
+        ladder.push_back(RiskBump(VOLATILITY,1,1e-2,i));
+    }
+    ladder.push_back(RiskBump(RISK_FREE_RATE,1));
+    for(int i=0; i<m; i++)
+        for(int j=i+1; j<m; j++)
+            ladder.push_back(RiskBump(CORRELATION,1,1e-2,i,j));
+    return ladder;
+}
+
+vector<double> Pricer::calcSensitivities(const vector<RiskBump>& bumps, string method,
+                                         const SimulationConfig& config, int numSim, int numSpace, int numThreads){
+    // the base and an up and a down move per bump are priced on their own copies of the pricer, all on
+    // one seed so that Monte Carlo scenarios share their random numbers and the noise cancels in the
+    // differences; scenarios run in parallel unless the paths come from the global generator
+    // (single-stock jump-diffusion), which is then reseeded before each scenario in turn and reseeded
+    // from a draw taken beforehand once done, so that later rand() calls do not replay the scenarios
+    logMessage(LOG_DEBUG,"starting calculation calcSensitivities on {} bumps, method {}, config {}, numSim {}",
+               bumps.size(),method,config,numSim);
+    int numBumps = (int)bumps.size(), numScenarios = 1+2*numBumps;
+    SimulationConfig crnConfig = config;
+    if(!crnConfig.seed) crnConfig.seed = (unsigned long)rand()+1;
+    vector<Pricer> scenarios(numScenarios,*this);
+    vector<double> dv(numBumps);
+    for(int k=0; k<numBumps; k++){
+        const RiskBump& bump = bumps[k];
+        double v = getVariable(bump.var,bump.i,bump.j);
+        dv[k] = bump.eps*(v!=0?fabs(v):1);
+        scenarios[1+2*k].setVariable(bump.var,v+dv[k],bump.i,bump.j);
+        scenarios[2+2*k].setVariable(bump.var,v-dv[k],bump.i,bump.j);
+    }
+    bool global = method=="Monte Carlo" && !_isReproducible(crnConfig);
+    bool parallel = numThreads!=1 && numScenarios>1 && !global;
+    if(parallel) crnConfig.numThreads = 1;
+    unsigned nextSeed = global?(unsigned)rand():0;
+    vector<double> prices(numScenarios);
+    parallelFor(numScenarios,[&](int s){
+        if(global) srand((unsigned)crnConfig.seed);
+        prices[s] = scenarios[s].calcPrice(method,crnConfig,numSim,numSpace);
+    },parallel?numThreads:1);
+    if(global) srand(nextSeed);
+    vector<double> sensitivities(numBumps,NAN);
+    for(int k=0; k<numBumps; k++){
+        double up = prices[1+2*k], down = prices[2+2*k];
+        switch(bumps[k].derivOrder){
+            case 1: sensitivities[k] = (up-down)/(2*dv[k]); break;
+            case 2: sensitivities[k] = (up-2*prices[0]+down)/(dv[k]*dv[k]); break;
+        }
+    }
+    price = prices[0];
+    logMessage(LOG_DEBUG,"ending calculation calcSensitivities, return {}",sensitivities);
+    return sensitivities;
+}
+
 matrix Pricer::varyGreekWithVariable(string var, const matrix& varVector, string greekName,
                                      string greekMethod, string method, const SimulationConfig& config, int numSim, double eps){
-    saveAsOriginal();
+    // points in parallel as in varyPriceWithVariable, PDE grid greeks in the current price off one solve
+    PricerVariable varId = parseVariable(var);
     int n = varVector.getCols();
-    double greek;
     matrix optionGreekVector(1,n);
-    for(int i=0; i<n; i++){
-        double v = varVector.getEntry(0,i);
-        setVariable(var,v);
-        greek = calcGreek(greekName,greekMethod,method,config,numSim,eps);
-        optionGreekVector.setEntry(0,i,greek);
+    if(greekMethod=="PDE Grid" && varId==CURRENT_PRICE){
+        PriceGrid grid = BlackScholesPDEGrid(config,numSim);
+        for(int i=0; i<n; i++){
+            Greeks greeks = grid.calcGreeks(varVector.getEntry(0,i));
+            double greek = NAN;
+            if(greekName=="Delta") greek = greeks.delta;
+            else if(greekName=="Gamma") greek = greeks.gamma;
+            else if(greekName=="Theta") greek = greeks.theta;
+            optionGreekVector.setEntry(0,i,greek);
+        }
+        return optionGreekVector;
     }
-    resetOriginal();
+    bool threaded = method=="Monte Carlo" && greekMethod!="Closed Form";
+    _forEachPoint(n,[&](Pricer& pricer, int i){
+        pricer.setVariable(varId,varVector.getEntry(0,i));
+        optionGreekVector.setEntry(0,i,pricer.calcGreek(greekName,greekMethod,method,config,numSim,eps));
+    },threaded?1:config.numThreads);
     return optionGreekVector;
 }
 
 matrix Pricer::generatePriceSurface(const matrix& stockPriceVector, const matrix& optionTermVector,
                                     string method, const SimulationConfig& config, int numSim){
-    saveAsOriginal();
+    // rows are terms and columns current prices, all points in parallel; the PDE solves once to the
+    // longest term in steps of config.stepSize and reads the term tau off the grid at time T-tau
     int m = optionTermVector.getCols();
     int n = stockPriceVector.getCols();
     matrix priceSurface(m,n);
-    for(int i=0; i<m; i++){
-        double term = optionTermVector.getEntry(0,i);
-        setVariable("maturity",term);
-        priceSurface.setRow(i,
-                            varyPriceWithVariable("currentPrice",stockPriceVector,method,config,numSim)
-                            );
+    if(method=="PDE Solver"){
+        double dt = config.stepSize;
+        SimulationConfig gridConfig(config);
+        gridConfig.iters = max(1,(int)ceil(max(optionTermVector)/dt-1e-9));
+        gridConfig.endTime = gridConfig.iters*dt;
+        Pricer pricer(*this);
+        pricer.setVariable(MATURITY,gridConfig.endTime);
+        PriceGrid grid = pricer.BlackScholesPDEGrid(gridConfig,numSim);
+        for(int i=0; i<m; i++)
+            for(int j=0; j<n; j++)
+                priceSurface.setEntry(i,j,grid.calcPrice(stockPriceVector.getEntry(0,j),
+                                                         gridConfig.endTime-optionTermVector.getEntry(0,i)));
+        return priceSurface;
     }
-    resetOriginal();
+    _forEachPoint(m*n,[&](Pricer& pricer, int k){
+        int i = k/n, j = k%n;
+        pricer.setVariable(MATURITY,optionTermVector.getEntry(0,i));
+        pricer.setVariable(CURRENT_PRICE,stockPriceVector.getEntry(0,j));
+        priceSurface.setEntry(i,j,pricer.calcPrice(method,config,numSim,numSim));
+    },(method=="Monte Carlo")?1:config.numThreads);
     return priceSurface;
 }
 
 bool Pricer::satisfyPriceBounds(double optionMarketPrice){
     if(option.getType()=="European"){
-        double K   = getVariable("strike");
-        double T   = getVariable("maturity");
-        double r   = getVariable("riskFreeRate");
-        double S0  = getVariable("currentPrice");
-        double q   = getVariable("dividendYield");
+        double K   = getVariable(STRIKE);
+        double T   = getVariable(MATURITY);
+        double r   = getVariable(RISK_FREE_RATE);
+        double S0  = getVariable(CURRENT_PRICE);
+        double q   = getVariable(DIVIDEND_YIELD);
         if(option.getPutCall()=="Call")
             return (optionMarketPrice<S0*exp(-q*T)) &&
             (optionMarketPrice>max(S0*exp(-q*T)-K*exp(-r*T),0.));
@@ -824,96 +1852,139 @@ bool Pricer::satisfyPriceBounds(double optionMarketPrice){
     return false;
 }
 
+inline double normalisedBlackPrice(double x, double s){
+    // undiscounted out-of-the-money call per sqrt(FK): b(x,s) = exp(x/2)N(x/s+s/2)-exp(-x/2)N(x/s-s/2),
+    // x = log(F/K) <= 0, s = sig*sqrt(T); db/ds = exp(-(x^2/s^2+s^2/4)/2)/sqrt(2pi)
+    return exp(x/2)*normalCDF(x/s+s/2)-exp(-x/2)*normalCDF(x/s-s/2);
+}
+
+double impliedNormalisedVolatility(double x, double beta, double tol){
+    // s such that b(x,s) = beta for x < 0 and 0 < beta < exp(x/2), to within tol in b; b is convex below
+    // s_c = sqrt(2|x|) and concave above. Below b(x,s_c) log b = log beta is solved from the small-s
+    // asymptotics b ~ s^3/x^2 n(x/s), above it b = beta from b ~ exp(x/2)-(exp(x/2)+exp(-x/2))N(-s/2),
+    // then third-order Householder steps with h2 = b''/b' = x^2/s^3-s/4, h3 = b'''/b' = h2^2-3x^2/s^4-1/4
+    // reach machine precision in two to three steps, safeguarded by the bracket of the increasing b
+    double ax = fabs(x), sc = sqrt(2*ax), bc = normalisedBlackPrice(x,sc);
+    double su = -2*normalInvCDF((exp(x/2)-beta)/(exp(x/2)+exp(-x/2)));
+    bool lower = beta<bc;
+    double s, logBeta = log(beta);
+    if(lower){
+        s = ax/sqrt(-2*logBeta);
+        for(int k=0; k<2; k++){
+            double rhs = 3*log(s)-2*log(ax)-0.5*log(2*M_PI)-s*s/8-logBeta;
+            if(rhs>0) s = ax/sqrt(2*rhs);
+        }
+        double err = INFINITY; // closest guess in log price, the asymptotics degrade towards s_c
+        for(double c:{s,su,sc}){
+            if(!(c>0) || c>sc) continue;
+            double e = fabs(log(normalisedBlackPrice(x,c))-logBeta);
+            if(e<err){err = e; s = c;}
+        }
+    }else s = max(su,sc);
+    double lo = 0, hi = INFINITY;
+    for(int n=0; n<100; n++){
+        double b = normalisedBlackPrice(x,s), vega = exp(-0.5*(x*x/(s*s)+s*s/4))/sqrt(2*M_PI);
+        double h2 = x*x/(s*s*s)-s/4, h3 = h2*h2-3*x*x/(s*s*s*s)-0.25, nu;
+        if(b>beta) hi = min(hi,s); else lo = max(lo,s);
+        if(fabs(b-beta)<=tol) break;
+        if(lower){ // same steps on log b, whose derivative ratios follow from those of b
+            double L1 = vega/b, L2 = h2*L1-L1*L1, L3 = h3*L1-3*h2*L1*L1+2*L1*L1*L1;
+            nu = -(log(b)-logBeta)/L1; h2 = L2/L1; h3 = L3/L1;
+        }else nu = -(b-beta)/vega;
+        double ds = nu*(1+0.5*h2*nu)/(1+nu*(h2+h3*nu/6));
+        if(fabs(ds)<=1e-7*s){s += ds; break;} // cubic convergence, the error left is of order ds^3
+        if(s+ds>lo && s+ds<hi) s += ds;
+        else s = isinf(hi)?2*s:(lo+hi)/2; // overshoot, double or bisect instead
+    }
+    return s;
+}
+
+double Pricer::BlackScholesImpliedVolatility(PutCall putCall, double optionPrice,
+                                             double S0, double K, double T, double r, double q, double eps){
+    // European price inverted on the normalised Black price to relative price error eps, in-the-money
+    // options through their time value so that x = -|log(F/K)|; NaN outside the no-arbitrage bounds
+    if(putCall==NO_PUT_CALL || !(T>0)) return NAN;
+    double F = S0*exp((r-q)*T), scale = exp(-r*T)*sqrt(F*K);
+    double x = log(F/K), w = (putCall==CALL)?1:-1;
+    double beta = optionPrice/scale-max(w*(exp(x/2)-exp(-x/2)),0.);
+    x = -fabs(x);
+    if(!(beta>0) || !(beta<exp(x/2))) return NAN;
+    if(x==0) return -2*normalInvCDF((1-beta)/2)/sqrt(T); // at the money: b = 2N(s/2)-1
+    return impliedNormalisedVolatility(x,beta,eps*optionPrice/scale)/sqrt(T);
+}
+
 double Pricer::calcImpliedVolatility(double optionMarketPrice, double vol0, double eps){
-    saveAsOriginal();
+    // European only, eps is the relative price error and vol0 the largest volatility returned
     double impliedVol = NAN;
-    double impliedVol0, impliedVol1;
-    double err = 1;
-    if(option.getType()=="European"){
-        impliedVol0 = 0;
-        impliedVol1 = vol0;
-        if(satisfyPriceBounds(optionMarketPrice)){
-            while(err>eps){
-                impliedVol = (impliedVol0+impliedVol1)/2;
-                setVariable("volatility",impliedVol);
-                price = calcPrice("Closed Form");
-                if(price>optionMarketPrice) impliedVol1 = impliedVol;
-                else if(price<optionMarketPrice) impliedVol0 = impliedVol;
-                err = abs(price-optionMarketPrice)/optionMarketPrice;
-                if(impliedVol==vol0) break;
-            }
-        }
+    if(option.getType()=="European" && satisfyPriceBounds(optionMarketPrice)){
+        PricingInputs<double> in = getPricingInputs();
+        impliedVol = min(BlackScholesImpliedVolatility(option.getPutCallId(),optionMarketPrice,
+                                                       in.S0,in.K,in.T,in.r,in.q,eps),vol0);
     }
-    resetOriginal();
     return impliedVol;
 }
 
-void Pricer::generateImpliedVolSurfaceFromFile(string input, string file, double vol0, double eps){
-    saveAsOriginal();
-    string name, type, putCall;
-    string strikeStr, maturityStr, optionMarketPriceStr;
-    double strike, maturity, optionMarketPrice;
-    double impliedVol;
-    ifstream fi(input);
-    ofstream fo; fo.open(file);
-    while(getline(fi,name,',')){
-        getline(fi,type,',');
-        getline(fi,putCall,',');
-        getline(fi,strikeStr,',');
-        getline(fi,maturityStr,',');
-        getline(fi,optionMarketPriceStr);
-        strike = stod(strikeStr);
-        maturity = stod(maturityStr);
-        optionMarketPrice = stod(optionMarketPriceStr);
-        option = Option(type,putCall,strike,maturity,{},{},name);
-        // cout << option << endl;
-        impliedVol = calcImpliedVolatility(optionMarketPrice,vol0,eps);
-        if(!isnan(impliedVol)) fo << name << "," << type << "," << putCall << "," <<
-            strike << "," << maturity << "," << impliedVol << endl;
-    }
-    fi.close();
-    fo.close();
-    resetOriginal();
+void Pricer::generateImpliedVolSurfaceFromFile(string input, string file, double vol0, double eps, int numThreads){
+    // rows name,type,putCall,strike,maturity,price in, name,type,putCall,strike,maturity,impliedVol out for the
+    // rows with an implied volatility; chunks of rows are solved in parallel and written in input order
+    auto t0 = chrono::steady_clock::now();
+    PricingInputs<double> in = getPricingInputs();
+    long numRows = processLinesInChunks(input,file,[&](const char *begin, const char *end, string& out){
+        StrView f[6];
+        char buf[128];
+        long n = 0;
+        for(const char *p=begin, *eol; p<end; p=eol+1){
+            eol = lineEnd(p,end);
+            if(splitFields(p,eol,f,6)<6) continue;
+            n++;
+            double strike = strtod(f[3].begin,NULL), maturity = strtod(f[4].begin,NULL);
+            double optionMarketPrice = strtod(f[5].begin,NULL);
+            string putCall = f[2].str();
+            if(f[1].str()!="European" || (putCall!="Call" && putCall!="Put")) continue;
+            double impliedVol = min(BlackScholesImpliedVolatility((putCall=="Call")?CALL:PUT,optionMarketPrice,
+                                                                  in.S0,strike,maturity,in.r,in.q,eps),vol0);
+            if(isnan(impliedVol)) continue;
+            out.append(f[0].begin,f[3].begin);
+            out.append(buf,snprintf(buf,sizeof(buf),"%g,%g,%g\n",strike,maturity,impliedVol));
+        }
+        return n;
+    },numThreads);
+    double t = chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    logMessage(LOG_INFO,"generateImpliedVolSurfaceFromFile: {} rows in {}s, {} rows/s",numRows,t,numRows/t);
 }
 
-void Pricer::generateGreeksFromImpliedVolFile(string input, string file){
-    saveAsOriginal();
-    string name, type, putCall;
-    string strikeStr, maturityStr, impliedVolStr;
-    double strike, maturity, impliedVol;
-    double Delta, Gamma, Vega, Rho, Theta;
-    ifstream fi(input);
-    ofstream fo; fo.open(file);
-    while(getline(fi,name,',')){
-        getline(fi,type,',');
-        getline(fi,putCall,',');
-        getline(fi,strikeStr,',');
-        getline(fi,maturityStr,',');
-        getline(fi,impliedVolStr);
-        strike = stod(strikeStr);
-        maturity = stod(maturityStr);
-        impliedVol = stod(impliedVolStr);
-        setVariable("volatility",impliedVol);
-        option = Option(type,putCall,strike,maturity,{},{},name);
-        // cout << option << endl;
-        Delta = calcGreek("Delta");
-        Gamma = calcGreek("Gamma");
-        Vega = calcGreek("Vega");
-        Rho = calcGreek("Rho");
-        Theta = calcGreek("Theta");
-        fo << name << "," << type << "," << putCall << "," <<
-        strike << "," << maturity << "," << impliedVol << "," << Delta << "," <<
-        Gamma << "," << Vega << "," << Rho << "," << Theta << endl;
-    }
-    fi.close();
-    fo.close();
-    resetOriginal();
+void Pricer::generateGreeksFromImpliedVolFile(string input, string file, int numThreads){
+    // rows name,type,putCall,strike,maturity,impliedVol in, closed-form greeks appended to each row out;
+    // chunks of rows are priced in parallel on their own copy of the pricer and written in input order
+    auto t0 = chrono::steady_clock::now();
+    long numRows = processLinesInChunks(input,file,[&](const char *begin, const char *end, string& out){
+        Pricer pricer(*this);
+        StrView f[6];
+        char buf[256];
+        long n = 0;
+        for(const char *p=begin, *eol; p<end; p=eol+1){
+            eol = lineEnd(p,end);
+            if(splitFields(p,eol,f,6)<6) continue;
+            n++;
+            double strike = strtod(f[3].begin,NULL), maturity = strtod(f[4].begin,NULL);
+            double impliedVol = strtod(f[5].begin,NULL);
+            pricer.setVariable(VOLATILITY,impliedVol);
+            pricer.option = Option(f[1].str(),f[2].str(),strike,maturity,{},{},f[0].str());
+            Greeks greeks = pricer.ClosedFormGreeks();
+            out.append(f[0].begin,f[3].begin);
+            out.append(buf,snprintf(buf,sizeof(buf),"%g,%g,%g,%g,%g,%g,%g,%g\n",strike,maturity,impliedVol,
+                                    greeks.delta,greeks.gamma,greeks.vega,greeks.rho,greeks.theta));
+        }
+        return n;
+    },numThreads);
+    double t = chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    logMessage(LOG_INFO,"generateGreeksFromImpliedVolFile: {} rows in {}s, {} rows/s",numRows,t,numRows/t);
 }
 
 vector<matrix> Pricer::modelImpliedVolSurface(const SimulationConfig& config, int numSpace,
                                               const function<double(double)>& impVolFunc0, const function<double(double)>& impVolFunc1,
                                               double lambdaT, double eps){
-    double K = getVariable("strike");
+    double K = getVariable(STRIKE);
     double T = config.endTime;
     int n = config.iters;
     int m = numSpace;
@@ -947,20 +2018,41 @@ vector<matrix> Pricer::modelImpliedVolSurface(const SimulationConfig& config, in
     impVolSurface.setRow(n,termCondition);
     impVolSurface.setCol(0,bdryCondition0);
     impVolSurface.setCol(m,bdryCondition1);
-    double err = 1;
-    while(err>eps){
-        matrix impVolSurfacePrev = impVolSurface;
-        for(int i=1; i<n; i++)
-            for(int j=1; j<m; j++){
-                double avg =
-                (impVolSurfacePrev.getEntry(i-1,j)+
-                 impVolSurfacePrev.getEntry(i+1,j)+
-                 impVolSurfacePrev.getEntry(i,j-1)+
-                 impVolSurfacePrev.getEntry(i,j+1))/4;
-                impVolSurface.setEntry(i,j,avg);
-            }
-        err = (impVolSurface-impVolSurfacePrev).sum()/impVolSurfacePrev.sum();
+    // interior is the average of its four neighbours: red-black SOR in place, each colour only reads the other
+    // so its rows update in parallel; stop when the max-norm residual is below eps relative to the boundary
+    vector<double> u((n+1)*(m+1));
+    for(int i=0; i<=n; i++){
+        vector<double> row = impVolSurface.getRowVector(i);
+        copy(row.begin(),row.end(),u.begin()+i*(m+1));
+    }
+    double scale = 0;
+    for(double v:u) scale = max(scale,fabs(v));
+    double rho = (cos(M_PI/n)+cos(M_PI/m))/2; // Jacobi spectral radius
+    double omega = 2/(1+sqrt(1-rho*rho));
+    int rowsPerChunk = max(1,(1<<16)/(m+1));
+    int numChunks = (n-1+rowsPerChunk-1)/rowsPerChunk;
+    vector<double> chunkRes(max(numChunks,0));
+    double res = (n>1 && m>1)?INFINITY:0;
+    TRACE_SPAN("modelImpliedVolSurface:linearSolve");
+    while(res>eps*scale){
+        res = 0;
+        for(int color=0; color<2; color++){
+            parallelFor(numChunks,[&](int c){
+                double r = 0;
+                for(int i=1+c*rowsPerChunk; i<min(n,1+(c+1)*rowsPerChunk); i++){
+                    double *U = &u[i*(m+1)];
+                    for(int j=1+(i+1+color)%2; j<m; j+=2){
+                        double d = (U[j-m-1]+U[j+m+1]+U[j-1]+U[j+1])/4-U[j];
+                        r = max(r,fabs(d));
+                        U[j] += omega*d;
+                    }
+                }
+                chunkRes[c] = (color==0)?r:max(chunkRes[c],r);
+            },config.numThreads);
+        }
+        for(double r:chunkRes) res = max(res,r);
     }
+    impVolSurface = matrix(n+1,m+1,&u[0]);
     // cout << impVolSurface.print() << endl;
     vector<matrix> impVolSurfaceSet{
         spaceGrids,
@@ -974,14 +2066,15 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                              string strategy, int hedgeFreq, double mktImpVol, double mktPrice,
                              const vector<double>& stratParams, const vector<Option>& hOptions, const vector<matrix>& impVolSurfaceSet,
                              string simPriceMethod, const matrix& stockPriceSeries){
-    if(GUI) cout << "running backtest for strategy: " << strategy << endl;
+    TRACE_SPAN("runBacktest");
+    if(GUI) logMessage(LOG_INFO,"running backtest for strategy: {}",strategy);
     Stock stock = market.getStock();
-    //    double K = getVariable("strike");
-    double T = getVariable("maturity");
-    double r = getVariable("riskFreeRate");
-    double S0 = getVariable("currentPrice");
-    double q = getVariable("dividendYield");
-    double sig = getVariable("volatility");
+    //    double K = getVariable(STRIKE);
+    double T = getVariable(MATURITY);
+    double r = getVariable(RISK_FREE_RATE);
+    double S0 = getVariable(CURRENT_PRICE);
+    double q = getVariable(DIVIDEND_YIELD);
+    double sig = getVariable(VOLATILITY);
     double sig2 = sig*sig;
     double dt = config.stepSize;
     double riskFreeRateFactor = exp(r*dt);
@@ -990,6 +2083,10 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
     bool flatImpVolSurface = impVolSurfaceSet.size()==0;
     if(simPriceMethod=="bootstrap")
         stock.bootstrapPrice(stockPriceSeries,config,numSim);
+    else if(simPriceMethod=="block bootstrap")
+        stock.bootstrapPrice(stockPriceSeries,config,numSim,"moving-block");
+    else if(simPriceMethod=="stationary bootstrap")
+        stock.bootstrapPrice(stockPriceSeries,config,numSim,"stationary");
     else stock.simulatePrice(config,numSim);
     int n = config.iters;
     matrix
@@ -1005,19 +2102,20 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
     vector<matrix>
     stratNOptions,
     stratHModPrices;
-    matrix simPriceMatrix = stock.getSimPriceMatrix();
+    const matrix& simPriceMatrix = stock.getSimPriceMatrix();
     if(strategy=="simple-delta" || strategy=="mkt-delta"){
         if(strategy=="mkt-delta"){
             double sigImp;
             if(mktImpVol>0) sigImp = mktImpVol;
             else sigImp = calcImpliedVolatility(mktPrice);
-            setVariable("volatility",sigImp);
+            setVariable(VOLATILITY,sigImp);
         }
         for(int i=0; i<numSim; i++){
-            setVariable("currentPrice",S0);
-            setVariable("maturity",T);
+            setVariable(CURRENT_PRICE,S0);
+            setVariable(MATURITY,T);
             double modPrice = calcPrice("Closed Form");
-            double nStock = calcGreek("Delta");
+            Greeks greeks = calcGreeks();
+            double nStock = greeks.delta;
             double cash = modPrice;
             cash -= nStock*S0;
             double value = cash+nStock*S0-modPrice;
@@ -1025,11 +2123,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratNStockMatrix.setEntry(0,i,nStock);
             stratModPriceMatrix.setEntry(0,i,modPrice);
             stratModValueMatrix.setEntry(0,i,value);
-            Delta = calcGreek("Delta");
-            Gamma = calcGreek("Gamma");
-            Vega = calcGreek("Vega");
-            Rho = calcGreek("Rho");
-            Theta = calcGreek("Theta");
+            Delta = greeks.delta;
+            Gamma = greeks.gamma;
+            Vega = greeks.vega;
+            Rho = greeks.rho;
+            Theta = greeks.theta;
             stratGrkDelta.setEntry(0,i,nStock-Delta);
             stratGrkGamma.setEntry(0,i,-Gamma);
             stratGrkVega.setEntry(0,i,-Vega);
@@ -1038,11 +2136,12 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             for(int t=1; t<n; t++){
                 double S = simPriceMatrix.getEntry(t,i);
                 double nStockPrev = nStock;
-                setVariable("currentPrice",S);
-                setVariable("maturity",T-t*dt);
+                setVariable(CURRENT_PRICE,S);
+                setVariable(MATURITY,T-t*dt);
                 modPrice = calcPrice("Closed Form");
+                Greeks greeks = calcGreeks();
                 if(t%hedgeFreq==0){
-                    nStock = calcGreek("Delta");
+                    nStock = greeks.delta;
                     cash = cash*riskFreeRateFactor
                     +nStock*S*(dividendYieldFactor-1)
                     -(nStock-nStockPrev)*S;
@@ -1055,11 +2154,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 stratNStockMatrix.setEntry(t,i,nStock);
                 stratModPriceMatrix.setEntry(t,i,modPrice);
                 stratModValueMatrix.setEntry(t,i,value);
-                Delta = calcGreek("Delta");
-                Gamma = calcGreek("Gamma");
-                Vega = calcGreek("Vega");
-                Rho = calcGreek("Rho");
-                Theta = calcGreek("Theta");
+                Delta = greeks.delta;
+                Gamma = greeks.gamma;
+                Vega = greeks.vega;
+                Rho = greeks.rho;
+                Theta = greeks.theta;
                 stratGrkDelta.setEntry(t,i,nStock-Delta);
                 stratGrkGamma.setEntry(t,i,-Gamma);
                 stratGrkVega.setEntry(t,i,-Vega);
@@ -1068,8 +2167,8 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             }
             double S1 = simPriceMatrix.getEntry(n,i);
             double nStockPrev = nStock;
-            setVariable("currentPrice",S1);
-            setVariable("maturity",0);
+            setVariable(CURRENT_PRICE,S1);
+            setVariable(MATURITY,0);
             modPrice = option.calcPayoff(S1);
             nStock = 0;
             cash = cash*riskFreeRateFactor+nStockPrev*S1;
@@ -1083,24 +2182,24 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratGrkVega.setEntry(n,i,0);
             stratGrkRho.setEntry(n,i,0);
             stratGrkTheta.setEntry(n,i,r*cash);
-            if(GUI) cout << "[" << getCurrentTime() << "] simulation " <<
-                i+1 << "/" << numSim << " completes" << endl;
+            if(GUI) logMessage(LOG_INFO,"simulation {}/{} completes",i+1,numSim);
         }
         // cout << stratModValueMatrix.print() << endl;
     }else if(strategy=="mkt-delta-hedgingVol"){
         double hedgingVol = stratParams[0];
         Pricer hPricer(*this);
-        hPricer.setVariable("volatility",hedgingVol);
+        hPricer.setVariable(VOLATILITY,hedgingVol);
         double sigImp;
         if(mktImpVol>0) sigImp = mktImpVol;
         else sigImp = calcImpliedVolatility(mktPrice);
-        setVariable("volatility",sigImp);
+        setVariable(VOLATILITY,sigImp);
         for(int i=0; i<numSim; i++){
-            setVariable("currentPrice",S0);
-            setVariable("maturity",T);
-            hPricer.setVariable("currentPrice",S0);
-            hPricer.setVariable("maturity",T);
+            setVariable(CURRENT_PRICE,S0);
+            setVariable(MATURITY,T);
+            hPricer.setVariable(CURRENT_PRICE,S0);
+            hPricer.setVariable(MATURITY,T);
             double modPrice = calcPrice("Closed Form");
+            Greeks greeks = calcGreeks();
             double nStock = hPricer.calcGreek("Delta");
             double cash = modPrice;
             cash -= nStock*S0;
@@ -1109,11 +2208,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratNStockMatrix.setEntry(0,i,nStock);
             stratModPriceMatrix.setEntry(0,i,modPrice);
             stratModValueMatrix.setEntry(0,i,value);
-            Delta = calcGreek("Delta");
-            Gamma = calcGreek("Gamma");
-            Vega = calcGreek("Vega");
-            Rho = calcGreek("Rho");
-            Theta = calcGreek("Theta");
+            Delta = greeks.delta;
+            Gamma = greeks.gamma;
+            Vega = greeks.vega;
+            Rho = greeks.rho;
+            Theta = greeks.theta;
             stratGrkDelta.setEntry(0,i,nStock-Delta);
             stratGrkGamma.setEntry(0,i,-Gamma);
             stratGrkVega.setEntry(0,i,-Vega);
@@ -1122,11 +2221,12 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             for(int t=1; t<n; t++){
                 double S = simPriceMatrix.getEntry(t,i);
                 double nStockPrev = nStock;
-                setVariable("currentPrice",S);
-                setVariable("maturity",T-t*dt);
-                hPricer.setVariable("currentPrice",S);
-                hPricer.setVariable("maturity",T-t*dt);
+                setVariable(CURRENT_PRICE,S);
+                setVariable(MATURITY,T-t*dt);
+                hPricer.setVariable(CURRENT_PRICE,S);
+                hPricer.setVariable(MATURITY,T-t*dt);
                 modPrice = calcPrice("Closed Form");
+                Greeks greeks = calcGreeks();
                 if(t%hedgeFreq==0){
                     nStock = hPricer.calcGreek("Delta");
                     cash = cash*riskFreeRateFactor
@@ -1141,11 +2241,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 stratNStockMatrix.setEntry(t,i,nStock);
                 stratModPriceMatrix.setEntry(t,i,modPrice);
                 stratModValueMatrix.setEntry(t,i,value);
-                Delta = calcGreek("Delta");
-                Gamma = calcGreek("Gamma");
-                Vega = calcGreek("Vega");
-                Rho = calcGreek("Rho");
-                Theta = calcGreek("Theta");
+                Delta = greeks.delta;
+                Gamma = greeks.gamma;
+                Vega = greeks.vega;
+                Rho = greeks.rho;
+                Theta = greeks.theta;
                 stratGrkDelta.setEntry(t,i,nStock-Delta);
                 stratGrkGamma.setEntry(t,i,-Gamma);
                 stratGrkVega.setEntry(t,i,-Vega);
@@ -1154,10 +2254,10 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             }
             double S1 = simPriceMatrix.getEntry(n,i);
             double nStockPrev = nStock;
-            setVariable("currentPrice",S1);
-            setVariable("maturity",0);
-            hPricer.setVariable("currentPrice",S1);
-            hPricer.setVariable("maturity",0);
+            setVariable(CURRENT_PRICE,S1);
+            setVariable(MATURITY,0);
+            hPricer.setVariable(CURRENT_PRICE,S1);
+            hPricer.setVariable(MATURITY,0);
             modPrice = option.calcPayoff(S1);
             nStock = 0;
             cash = cash*riskFreeRateFactor+nStockPrev*S1;
@@ -1171,8 +2271,7 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratGrkVega.setEntry(n,i,0);
             stratGrkRho.setEntry(n,i,0);
             stratGrkTheta.setEntry(n,i,r*cash);
-            if(GUI) cout << "[" << getCurrentTime() << "] simulation " <<
-                i+1 << "/" << numSim << " completes" << endl;
+            if(GUI) logMessage(LOG_INFO,"simulation {}/{} completes",i+1,numSim);
         }
     }else if(strategy=="simple-delta-gamma" || strategy=="mkt-delta-gamma"){
         double hDelta, hGamma, hVega, hRho, hTheta;
@@ -1180,25 +2279,27 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
         stratHModPrices.push_back(matrix(n+1,numSim));
         Option hOption = hOptions[0];
         Pricer hPricer(hOption,market);
-        double Th = hPricer.getVariable("maturity");
+        hPricer.setPriceCache(cache);
+        double Th = hPricer.getVariable(MATURITY);
         double O0 = hPricer.calcPrice("Closed Form");
         if(strategy=="mkt-delta-gamma"){
             double sigImp;
             if(mktImpVol>0) sigImp = mktImpVol;
             else sigImp = calcImpliedVolatility(mktPrice);
-            setVariable("volatility",sigImp);
-            hPricer.setVariable("volatility",sigImp);
+            setVariable(VOLATILITY,sigImp);
+            hPricer.setVariable(VOLATILITY,sigImp);
         }
         for(int i=0; i<numSim; i++){
-            setVariable("currentPrice",S0);
-            setVariable("maturity",T);
-            hPricer.setVariable("currentPrice",S0);
-            hPricer.setVariable("maturity",Th);
+            setVariable(CURRENT_PRICE,S0);
+            setVariable(MATURITY,T);
+            hPricer.setVariable(CURRENT_PRICE,S0);
+            hPricer.setVariable(MATURITY,Th);
             double modPrice = calcPrice("Closed Form");
-            double nOption = calcGreek("Gamma")
-            /hPricer.calcGreek("Gamma");
-            double nStock = calcGreek("Delta")
-            -nOption*hPricer.calcGreek("Delta");
+            Greeks greeks = calcGreeks(), hGreeks = hPricer.calcGreeks();
+            double nOption = greeks.gamma
+            /hGreeks.gamma;
+            double nStock = greeks.delta
+            -nOption*hGreeks.delta;
             double cash = modPrice;
             cash -= nStock*S0+nOption*O0;
             double value = cash+nStock*S0+nOption*O0-modPrice;
@@ -1206,11 +2307,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratNStockMatrix.setEntry(0,i,nStock);
             stratModPriceMatrix.setEntry(0,i,modPrice);
             stratModValueMatrix.setEntry(0,i,value);
-            Delta = calcGreek("Delta"); hDelta = hPricer.calcGreek("Delta");
-            Gamma = calcGreek("Gamma"); hGamma = hPricer.calcGreek("Gamma");
-            Vega = calcGreek("Vega"); hVega = hPricer.calcGreek("Vega");
-            Rho = calcGreek("Rho"); hRho = hPricer.calcGreek("Rho");
-            Theta = calcGreek("Theta"); hTheta = hPricer.calcGreek("Theta");
+            Delta = greeks.delta; hDelta = hGreeks.delta;
+            Gamma = greeks.gamma; hGamma = hGreeks.gamma;
+            Vega = greeks.vega; hVega = hGreeks.vega;
+            Rho = greeks.rho; hRho = hGreeks.rho;
+            Theta = greeks.theta; hTheta = hGreeks.theta;
             stratGrkDelta.setEntry(0,i,nStock+nOption*hDelta-Delta);
             stratGrkGamma.setEntry(0,i,nOption*hGamma-Gamma);
             stratGrkVega.setEntry(0,i,nOption*hVega-Vega);
@@ -1222,17 +2323,18 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 double S = simPriceMatrix.getEntry(t,i);
                 double nStockPrev = nStock;
                 double nOptionPrev = nOption;
-                setVariable("currentPrice",S);
-                setVariable("maturity",T-t*dt);
-                hPricer.setVariable("currentPrice",S);
-                hPricer.setVariable("maturity",Th-t*dt);
+                setVariable(CURRENT_PRICE,S);
+                setVariable(MATURITY,T-t*dt);
+                hPricer.setVariable(CURRENT_PRICE,S);
+                hPricer.setVariable(MATURITY,Th-t*dt);
                 double O = hPricer.calcPrice("Closed Form");
                 modPrice = calcPrice("Closed Form");
+                Greeks greeks = calcGreeks(), hGreeks = hPricer.calcGreeks();
                 if(t%hedgeFreq==0){
-                    nOption = calcGreek("Gamma")
-                    /hPricer.calcGreek("Gamma");
-                    nStock = calcGreek("Delta")
-                    -nOption*hPricer.calcGreek("Delta");
+                    nOption = greeks.gamma
+                    /hGreeks.gamma;
+                    nStock = greeks.delta
+                    -nOption*hGreeks.delta;
                     cash = cash*riskFreeRateFactor
                     +nStock*S*(dividendYieldFactor-1)
                     -(nStock-nStockPrev)*S
@@ -1246,11 +2348,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 stratNStockMatrix.setEntry(t,i,nStock);
                 stratModPriceMatrix.setEntry(t,i,modPrice);
                 stratModValueMatrix.setEntry(t,i,value);
-                Delta = calcGreek("Delta"); hDelta = hPricer.calcGreek("Delta");
-                Gamma = calcGreek("Gamma"); hGamma = hPricer.calcGreek("Gamma");
-                Vega = calcGreek("Vega"); hVega = hPricer.calcGreek("Vega");
-                Rho = calcGreek("Rho"); hRho = hPricer.calcGreek("Rho");
-                Theta = calcGreek("Theta"); hTheta = hPricer.calcGreek("Theta");
+                Delta = greeks.delta; hDelta = hGreeks.delta;
+                Gamma = greeks.gamma; hGamma = hGreeks.gamma;
+                Vega = greeks.vega; hVega = hGreeks.vega;
+                Rho = greeks.rho; hRho = hGreeks.rho;
+                Theta = greeks.theta; hTheta = hGreeks.theta;
                 stratGrkDelta.setEntry(t,i,nStock+nOption*hDelta-Delta);
                 stratGrkGamma.setEntry(t,i,nOption*hGamma-Gamma);
                 stratGrkVega.setEntry(t,i,nOption*hVega-Vega);
@@ -1262,10 +2364,10 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             double S1 = simPriceMatrix.getEntry(n,i);
             double nStockPrev = nStock;
             double nOptionPrev = nOption;
-            setVariable("currentPrice",S1);
-            setVariable("maturity",0);
-            hPricer.setVariable("currentPrice",S1);
-            hPricer.setVariable("maturity",Th-n*dt);
+            setVariable(CURRENT_PRICE,S1);
+            setVariable(MATURITY,0);
+            hPricer.setVariable(CURRENT_PRICE,S1);
+            hPricer.setVariable(MATURITY,Th-n*dt);
             double O1 = hPricer.calcPrice("Closed Form");
             modPrice = option.calcPayoff(S1);
             nStock = 0;
@@ -1283,8 +2385,7 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratGrkTheta.setEntry(n,i,r*cash);
             stratNOptions[0].setEntry(n,i,nOption);
             stratHModPrices[0].setEntry(n,i,O1);
-            if(GUI) cout << "[" << getCurrentTime() << "] simulation " <<
-                i+1 << "/" << numSim << " completes" << endl;
+            if(GUI) logMessage(LOG_INFO,"simulation {}/{} completes",i+1,numSim);
         }
     }else if(strategy=="simple-delta-gamma-theta" || strategy=="mkt-delta-gamma-theta"){
         double hDelta0, hGamma0, hVega0, hRho0, hTheta0;
@@ -1295,36 +2396,38 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
         }
         Option hOption0 = hOptions[0], hOption1 = hOptions[1];
         Pricer hPricer0(hOption0,market), hPricer1(hOption1,market);
-        double Th0 = hPricer0.getVariable("maturity");
-        double Th1 = hPricer1.getVariable("maturity");
+        hPricer0.setPriceCache(cache); hPricer1.setPriceCache(cache);
+        double Th0 = hPricer0.getVariable(MATURITY);
+        double Th1 = hPricer1.getVariable(MATURITY);
         double O00 = hPricer0.calcPrice("Closed Form");
         double O10 = hPricer1.calcPrice("Closed Form");
         if(strategy=="mkt-delta-gamma-theta"){
             double sigImp;
             if(mktImpVol>0) sigImp = mktImpVol;
             else sigImp = calcImpliedVolatility(mktPrice);
-            setVariable("volatility",sigImp);
-            hPricer0.setVariable("volatility",sigImp);
-            hPricer1.setVariable("volatility",sigImp);
+            setVariable(VOLATILITY,sigImp);
+            hPricer0.setVariable(VOLATILITY,sigImp);
+            hPricer1.setVariable(VOLATILITY,sigImp);
         }
         for(int i=0; i<numSim; i++){
-            setVariable("currentPrice",S0);
-            setVariable("maturity",T);
-            hPricer0.setVariable("currentPrice",S0);
-            hPricer0.setVariable("maturity",Th0);
-            hPricer1.setVariable("currentPrice",S0);
-            hPricer1.setVariable("maturity",Th1);
+            setVariable(CURRENT_PRICE,S0);
+            setVariable(MATURITY,T);
+            hPricer0.setVariable(CURRENT_PRICE,S0);
+            hPricer0.setVariable(MATURITY,Th0);
+            hPricer1.setVariable(CURRENT_PRICE,S0);
+            hPricer1.setVariable(MATURITY,Th1);
             double modPrice = calcPrice("Closed Form");
+            Greeks greeks = calcGreeks(), hGreeks0 = hPricer0.calcGreeks(), hGreeks1 = hPricer1.calcGreeks();
             double tmpM[2][2]
-            = {{hPricer0.calcGreek("Theta"),hPricer1.calcGreek("Theta")},
-                hPricer0.calcGreek("Gamma"),hPricer1.calcGreek("Gamma")};
-            double tmpV[2] = {calcGreek("Theta"),calcGreek("Gamma")};
+            = {{hGreeks0.theta,hGreeks1.theta},
+                hGreeks0.gamma,hGreeks1.gamma};
+            double tmpV[2] = {greeks.theta,greeks.gamma};
             matrix nOptions = matrix(tmpM).inverse().dot(matrix(tmpV).T());
             double nOption0 = nOptions.getEntry(0,0),
             nOption1 = nOptions.getEntry(1,0);
-            double nStock = calcGreek("Delta")
-            -nOption0*hPricer0.calcGreek("Delta")
-            -nOption1*hPricer1.calcGreek("Delta");
+            double nStock = greeks.delta
+            -nOption0*hGreeks0.delta
+            -nOption1*hGreeks1.delta;
             double cash = modPrice;
             cash -= nStock*S0+nOption0*O00+nOption1*O10;
             double value = cash+nStock*S0+nOption0*O00+nOption1*O10-modPrice;
@@ -1332,11 +2435,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratNStockMatrix.setEntry(0,i,nStock);
             stratModPriceMatrix.setEntry(0,i,modPrice);
             stratModValueMatrix.setEntry(0,i,value);
-            Delta = calcGreek("Delta"); hDelta0 = hPricer0.calcGreek("Delta"); hDelta1 = hPricer1.calcGreek("Delta");
-            Gamma = calcGreek("Gamma"); hGamma0 = hPricer0.calcGreek("Gamma"); hGamma1 = hPricer1.calcGreek("Gamma");
-            Vega = calcGreek("Vega"); hVega0 = hPricer0.calcGreek("Vega"); hVega1 = hPricer1.calcGreek("Vega");
-            Rho = calcGreek("Rho"); hRho0 = hPricer0.calcGreek("Rho"); hRho1 = hPricer1.calcGreek("Rho");
-            Theta = calcGreek("Theta"); hTheta0 = hPricer0.calcGreek("Theta"); hTheta1 = hPricer1.calcGreek("Theta");
+            Delta = greeks.delta; hDelta0 = hGreeks0.delta; hDelta1 = hGreeks1.delta;
+            Gamma = greeks.gamma; hGamma0 = hGreeks0.gamma; hGamma1 = hGreeks1.gamma;
+            Vega = greeks.vega; hVega0 = hGreeks0.vega; hVega1 = hGreeks1.vega;
+            Rho = greeks.rho; hRho0 = hGreeks0.rho; hRho1 = hGreeks1.rho;
+            Theta = greeks.theta; hTheta0 = hGreeks0.theta; hTheta1 = hGreeks1.theta;
             stratGrkDelta.setEntry(0,i,nStock+nOption0*hDelta0+nOption1*hDelta1-Delta);
             stratGrkGamma.setEntry(0,i,nOption0*hGamma0+nOption1*hGamma1-Gamma);
             stratGrkVega.setEntry(0,i,nOption0*hVega0+nOption1*hVega1-Vega);
@@ -1351,26 +2454,27 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 double nStockPrev = nStock;
                 double nOptionPrev0 = nOption0;
                 double nOptionPrev1 = nOption1;
-                setVariable("currentPrice",S);
-                setVariable("maturity",T-t*dt);
-                hPricer0.setVariable("currentPrice",S);
-                hPricer0.setVariable("maturity",Th0-t*dt);
-                hPricer1.setVariable("currentPrice",S);
-                hPricer1.setVariable("maturity",Th1-t*dt);
+                setVariable(CURRENT_PRICE,S);
+                setVariable(MATURITY,T-t*dt);
+                hPricer0.setVariable(CURRENT_PRICE,S);
+                hPricer0.setVariable(MATURITY,Th0-t*dt);
+                hPricer1.setVariable(CURRENT_PRICE,S);
+                hPricer1.setVariable(MATURITY,Th1-t*dt);
                 double O0 = hPricer0.calcPrice("Closed Form");
                 double O1 = hPricer1.calcPrice("Closed Form");
                 modPrice = calcPrice("Closed Form");
+                Greeks greeks = calcGreeks(), hGreeks0 = hPricer0.calcGreeks(), hGreeks1 = hPricer1.calcGreeks();
                 if(t%hedgeFreq==0){
                     double tmpM[2][2]
-                    = {{hPricer0.calcGreek("Theta"),hPricer1.calcGreek("Theta")},
-                        hPricer0.calcGreek("Gamma"),hPricer1.calcGreek("Gamma")};
-                    double tmpV[2] = {calcGreek("Theta"),calcGreek("Gamma")};
+                    = {{hGreeks0.theta,hGreeks1.theta},
+                        hGreeks0.gamma,hGreeks1.gamma};
+                    double tmpV[2] = {greeks.theta,greeks.gamma};
                     nOptions = matrix(tmpM).inverse().dot(matrix(tmpV).T());
                     nOption0 = nOptions.getEntry(0,0),
                     nOption1 = nOptions.getEntry(1,0);
-                    nStock = calcGreek("Delta")
-                    -nOption0*hPricer0.calcGreek("Delta")
-                    -nOption1*hPricer1.calcGreek("Delta");
+                    nStock = greeks.delta
+                    -nOption0*hGreeks0.delta
+                    -nOption1*hGreeks1.delta;
                     cash = cash*riskFreeRateFactor
                     +nStock*S*(dividendYieldFactor-1)
                     -(nStock-nStockPrev)*S
@@ -1385,11 +2489,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 stratNStockMatrix.setEntry(t,i,nStock);
                 stratModPriceMatrix.setEntry(t,i,modPrice);
                 stratModValueMatrix.setEntry(t,i,value);
-                Delta = calcGreek("Delta"); hDelta0 = hPricer0.calcGreek("Delta"); hDelta1 = hPricer1.calcGreek("Delta");
-                Gamma = calcGreek("Gamma"); hGamma0 = hPricer0.calcGreek("Gamma"); hGamma1 = hPricer1.calcGreek("Gamma");
-                Vega = calcGreek("Vega"); hVega0 = hPricer0.calcGreek("Vega"); hVega1 = hPricer1.calcGreek("Vega");
-                Rho = calcGreek("Rho"); hRho0 = hPricer0.calcGreek("Rho"); hRho1 = hPricer1.calcGreek("Rho");
-                Theta = calcGreek("Theta"); hTheta0 = hPricer0.calcGreek("Theta"); hTheta1 = hPricer1.calcGreek("Theta");
+                Delta = greeks.delta; hDelta0 = hGreeks0.delta; hDelta1 = hGreeks1.delta;
+                Gamma = greeks.gamma; hGamma0 = hGreeks0.gamma; hGamma1 = hGreeks1.gamma;
+                Vega = greeks.vega; hVega0 = hGreeks0.vega; hVega1 = hGreeks1.vega;
+                Rho = greeks.rho; hRho0 = hGreeks0.rho; hRho1 = hGreeks1.rho;
+                Theta = greeks.theta; hTheta0 = hGreeks0.theta; hTheta1 = hGreeks1.theta;
                 stratGrkDelta.setEntry(t,i,nStock+nOption0*hDelta0+nOption1*hDelta1-Delta);
                 stratGrkGamma.setEntry(t,i,nOption0*hGamma0+nOption1*hGamma1-Gamma);
                 stratGrkVega.setEntry(t,i,nOption0*hVega0+nOption1*hVega1-Vega);
@@ -1404,12 +2508,12 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             double nStockPrev = nStock;
             double nOptionPrev0 = nOption0;
             double nOptionPrev1 = nOption1;
-            setVariable("currentPrice",S1);
-            setVariable("maturity",0);
-            hPricer0.setVariable("currentPrice",S1);
-            hPricer0.setVariable("maturity",Th0-n*dt);
-            hPricer1.setVariable("currentPrice",S1);
-            hPricer1.setVariable("maturity",Th1-n*dt);
+            setVariable(CURRENT_PRICE,S1);
+            setVariable(MATURITY,0);
+            hPricer0.setVariable(CURRENT_PRICE,S1);
+            hPricer0.setVariable(MATURITY,Th0-n*dt);
+            hPricer1.setVariable(CURRENT_PRICE,S1);
+            hPricer1.setVariable(MATURITY,Th1-n*dt);
             double O01 = hPricer0.calcPrice("Closed Form");
             double O11 = hPricer1.calcPrice("Closed Form");
             modPrice = option.calcPayoff(S1);
@@ -1431,8 +2535,7 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratNOptions[1].setEntry(n,i,nOption1);
             stratHModPrices[0].setEntry(n,i,O01);
             stratHModPrices[1].setEntry(n,i,O11);
-            if(GUI) cout << "[" << getCurrentTime() << "] simulation " <<
-                i+1 << "/" << numSim << " completes" << endl;
+            if(GUI) logMessage(LOG_INFO,"simulation {}/{} completes",i+1,numSim);
         }
     }else if(strategy=="vol-delta-gamma-theta"){
         double hDelta0, hGamma0, hVega0, hRho0, hTheta0;
@@ -1443,42 +2546,44 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
         }
         Option hOption0 = hOptions[0], hOption1 = hOptions[1];
         Pricer hPricer0(hOption0,market), hPricer1(hOption1,market);
-        double Th0 = hPricer0.getVariable("maturity");
-        double Th1 = hPricer1.getVariable("maturity");
+        hPricer0.setPriceCache(cache); hPricer1.setPriceCache(cache);
+        double Th0 = hPricer0.getVariable(MATURITY);
+        double Th1 = hPricer1.getVariable(MATURITY);
         double O00 = hPricer0.calcPrice("Closed Form");
         double O10 = hPricer1.calcPrice("Closed Form");
         int idxK, idxK0, idxK1, idxT, idxT0, idxT1;
         if(!flatImpVolSurface){
-            idxK = impVolSurfaceSet[0].find(log(getVariable("strike")),"closest")[1];
-            idxK0 = impVolSurfaceSet[0].find(log(hPricer0.getVariable("strike")),"closest")[1];
-            idxK1 = impVolSurfaceSet[0].find(log(hPricer1.getVariable("strike")),"closest")[1];
+            idxK = impVolSurfaceSet[0].find(log(getVariable(STRIKE)),"closest")[1];
+            idxK0 = impVolSurfaceSet[0].find(log(hPricer0.getVariable(STRIKE)),"closest")[1];
+            idxK1 = impVolSurfaceSet[0].find(log(hPricer1.getVariable(STRIKE)),"closest")[1];
         }
         for(int i=0; i<numSim; i++){
-            setVariable("currentPrice",S0);
-            setVariable("maturity",T);
-            hPricer0.setVariable("currentPrice",S0);
-            hPricer0.setVariable("maturity",Th0);
-            hPricer1.setVariable("currentPrice",S0);
-            hPricer1.setVariable("maturity",Th1);
+            setVariable(CURRENT_PRICE,S0);
+            setVariable(MATURITY,T);
+            hPricer0.setVariable(CURRENT_PRICE,S0);
+            hPricer0.setVariable(MATURITY,Th0);
+            hPricer1.setVariable(CURRENT_PRICE,S0);
+            hPricer1.setVariable(MATURITY,Th1);
             if(!flatImpVolSurface){
-                idxT = impVolSurfaceSet[1].find(log(getVariable("maturity")),"closest")[1];
-                idxT0 = impVolSurfaceSet[1].find(log(hPricer0.getVariable("maturity")),"closest")[1];
-                idxT1 = impVolSurfaceSet[1].find(log(hPricer1.getVariable("maturity")),"closest")[1];
-                setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT,idxK));
-                hPricer0.setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT0,idxK0));
-                hPricer1.setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT1,idxK1));
+                idxT = impVolSurfaceSet[1].find(log(getVariable(MATURITY)),"closest")[1];
+                idxT0 = impVolSurfaceSet[1].find(log(hPricer0.getVariable(MATURITY)),"closest")[1];
+                idxT1 = impVolSurfaceSet[1].find(log(hPricer1.getVariable(MATURITY)),"closest")[1];
+                setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT,idxK));
+                hPricer0.setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT0,idxK0));
+                hPricer1.setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT1,idxK1));
             }
             double modPrice = calcPrice("Closed Form");
+            Greeks greeks = calcGreeks(), hGreeks0 = hPricer0.calcGreeks(), hGreeks1 = hPricer1.calcGreeks();
             double tmpM[2][2]
-            = {{hPricer0.calcGreek("Theta"),hPricer1.calcGreek("Theta")},
-                hPricer0.calcGreek("Gamma"),hPricer1.calcGreek("Gamma")};
-            double tmpV[2] = {calcGreek("Theta"),calcGreek("Gamma")};
+            = {{hGreeks0.theta,hGreeks1.theta},
+                hGreeks0.gamma,hGreeks1.gamma};
+            double tmpV[2] = {greeks.theta,greeks.gamma};
             matrix nOptions = matrix(tmpM).inverse().dot(matrix(tmpV).T());
             double nOption0 = nOptions.getEntry(0,0),
             nOption1 = nOptions.getEntry(1,0);
-            double nStock = calcGreek("Delta")
-            -nOption0*hPricer0.calcGreek("Delta")
-            -nOption1*hPricer1.calcGreek("Delta");
+            double nStock = greeks.delta
+            -nOption0*hGreeks0.delta
+            -nOption1*hGreeks1.delta;
             double cash = modPrice;
             cash -= nStock*S0+nOption0*O00+nOption1*O10;
             double value = cash+nStock*S0+nOption0*O00+nOption1*O10-modPrice;
@@ -1486,11 +2591,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratNStockMatrix.setEntry(0,i,nStock);
             stratModPriceMatrix.setEntry(0,i,modPrice);
             stratModValueMatrix.setEntry(0,i,value);
-            Delta = calcGreek("Delta"); hDelta0 = hPricer0.calcGreek("Delta"); hDelta1 = hPricer1.calcGreek("Delta");
-            Gamma = calcGreek("Gamma"); hGamma0 = hPricer0.calcGreek("Gamma"); hGamma1 = hPricer1.calcGreek("Gamma");
-            Vega = calcGreek("Vega"); hVega0 = hPricer0.calcGreek("Vega"); hVega1 = hPricer1.calcGreek("Vega");
-            Rho = calcGreek("Rho"); hRho0 = hPricer0.calcGreek("Rho"); hRho1 = hPricer1.calcGreek("Rho");
-            Theta = calcGreek("Theta"); hTheta0 = hPricer0.calcGreek("Theta"); hTheta1 = hPricer1.calcGreek("Theta");
+            Delta = greeks.delta; hDelta0 = hGreeks0.delta; hDelta1 = hGreeks1.delta;
+            Gamma = greeks.gamma; hGamma0 = hGreeks0.gamma; hGamma1 = hGreeks1.gamma;
+            Vega = greeks.vega; hVega0 = hGreeks0.vega; hVega1 = hGreeks1.vega;
+            Rho = greeks.rho; hRho0 = hGreeks0.rho; hRho1 = hGreeks1.rho;
+            Theta = greeks.theta; hTheta0 = hGreeks0.theta; hTheta1 = hGreeks1.theta;
             stratGrkDelta.setEntry(0,i,nStock+nOption0*hDelta0+nOption1*hDelta1-Delta);
             stratGrkGamma.setEntry(0,i,nOption0*hGamma0+nOption1*hGamma1-Gamma);
             stratGrkVega.setEntry(0,i,nOption0*hVega0+nOption1*hVega1-Vega);
@@ -1505,34 +2610,35 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 double nStockPrev = nStock;
                 double nOptionPrev0 = nOption0;
                 double nOptionPrev1 = nOption1;
-                setVariable("currentPrice",S);
-                setVariable("maturity",T-t*dt);
-                hPricer0.setVariable("currentPrice",S);
-                hPricer0.setVariable("maturity",Th0-t*dt);
-                hPricer1.setVariable("currentPrice",S);
-                hPricer1.setVariable("maturity",Th1-t*dt);
+                setVariable(CURRENT_PRICE,S);
+                setVariable(MATURITY,T-t*dt);
+                hPricer0.setVariable(CURRENT_PRICE,S);
+                hPricer0.setVariable(MATURITY,Th0-t*dt);
+                hPricer1.setVariable(CURRENT_PRICE,S);
+                hPricer1.setVariable(MATURITY,Th1-t*dt);
                 if(!flatImpVolSurface){
-                    idxT = impVolSurfaceSet[1].find(log(getVariable("maturity")),"closest")[1];
-                    idxT0 = impVolSurfaceSet[1].find(log(hPricer0.getVariable("maturity")),"closest")[1];
-                    idxT1 = impVolSurfaceSet[1].find(log(hPricer1.getVariable("maturity")),"closest")[1];
-                    setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT,idxK));
-                    hPricer0.setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT0,idxK0));
-                    hPricer1.setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT1,idxK1));
+                    idxT = impVolSurfaceSet[1].find(log(getVariable(MATURITY)),"closest")[1];
+                    idxT0 = impVolSurfaceSet[1].find(log(hPricer0.getVariable(MATURITY)),"closest")[1];
+                    idxT1 = impVolSurfaceSet[1].find(log(hPricer1.getVariable(MATURITY)),"closest")[1];
+                    setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT,idxK));
+                    hPricer0.setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT0,idxK0));
+                    hPricer1.setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT1,idxK1));
                 }
                 double O0 = hPricer0.calcPrice("Closed Form");
                 double O1 = hPricer1.calcPrice("Closed Form");
                 modPrice = calcPrice("Closed Form");
+                Greeks greeks = calcGreeks(), hGreeks0 = hPricer0.calcGreeks(), hGreeks1 = hPricer1.calcGreeks();
                 if(t%hedgeFreq==0){
                     double tmpM[2][2]
-                    = {{hPricer0.calcGreek("Theta"),hPricer1.calcGreek("Theta")},
-                        hPricer0.calcGreek("Gamma"),hPricer1.calcGreek("Gamma")};
-                    double tmpV[2] = {calcGreek("Theta"),calcGreek("Gamma")};
+                    = {{hGreeks0.theta,hGreeks1.theta},
+                        hGreeks0.gamma,hGreeks1.gamma};
+                    double tmpV[2] = {greeks.theta,greeks.gamma};
                     nOptions = matrix(tmpM).inverse().dot(matrix(tmpV).T());
                     nOption0 = nOptions.getEntry(0,0),
                     nOption1 = nOptions.getEntry(1,0);
-                    nStock = calcGreek("Delta")
-                    -nOption0*hPricer0.calcGreek("Delta")
-                    -nOption1*hPricer1.calcGreek("Delta");
+                    nStock = greeks.delta
+                    -nOption0*hGreeks0.delta
+                    -nOption1*hGreeks1.delta;
                     cash = cash*riskFreeRateFactor
                     +nStock*S*(dividendYieldFactor-1)
                     -(nStock-nStockPrev)*S
@@ -1547,11 +2653,11 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
                 stratNStockMatrix.setEntry(t,i,nStock);
                 stratModPriceMatrix.setEntry(t,i,modPrice);
                 stratModValueMatrix.setEntry(t,i,value);
-                Delta = calcGreek("Delta"); hDelta0 = hPricer0.calcGreek("Delta"); hDelta1 = hPricer1.calcGreek("Delta");
-                Gamma = calcGreek("Gamma"); hGamma0 = hPricer0.calcGreek("Gamma"); hGamma1 = hPricer1.calcGreek("Gamma");
-                Vega = calcGreek("Vega"); hVega0 = hPricer0.calcGreek("Vega"); hVega1 = hPricer1.calcGreek("Vega");
-                Rho = calcGreek("Rho"); hRho0 = hPricer0.calcGreek("Rho"); hRho1 = hPricer1.calcGreek("Rho");
-                Theta = calcGreek("Theta"); hTheta0 = hPricer0.calcGreek("Theta"); hTheta1 = hPricer1.calcGreek("Theta");
+                Delta = greeks.delta; hDelta0 = hGreeks0.delta; hDelta1 = hGreeks1.delta;
+                Gamma = greeks.gamma; hGamma0 = hGreeks0.gamma; hGamma1 = hGreeks1.gamma;
+                Vega = greeks.vega; hVega0 = hGreeks0.vega; hVega1 = hGreeks1.vega;
+                Rho = greeks.rho; hRho0 = hGreeks0.rho; hRho1 = hGreeks1.rho;
+                Theta = greeks.theta; hTheta0 = hGreeks0.theta; hTheta1 = hGreeks1.theta;
                 stratGrkDelta.setEntry(t,i,nStock+nOption0*hDelta0+nOption1*hDelta1-Delta);
                 stratGrkGamma.setEntry(t,i,nOption0*hGamma0+nOption1*hGamma1-Gamma);
                 stratGrkVega.setEntry(t,i,nOption0*hVega0+nOption1*hVega1-Vega);
@@ -1566,19 +2672,19 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             double nStockPrev = nStock;
             double nOptionPrev0 = nOption0;
             double nOptionPrev1 = nOption1;
-            setVariable("currentPrice",S1);
-            setVariable("maturity",0);
-            hPricer0.setVariable("currentPrice",S1);
-            hPricer0.setVariable("maturity",Th0-n*dt);
-            hPricer1.setVariable("currentPrice",S1);
-            hPricer1.setVariable("maturity",Th1-n*dt);
+            setVariable(CURRENT_PRICE,S1);
+            setVariable(MATURITY,0);
+            hPricer0.setVariable(CURRENT_PRICE,S1);
+            hPricer0.setVariable(MATURITY,Th0-n*dt);
+            hPricer1.setVariable(CURRENT_PRICE,S1);
+            hPricer1.setVariable(MATURITY,Th1-n*dt);
             if(!flatImpVolSurface){
-                idxT = impVolSurfaceSet[1].find(log(getVariable("maturity")),"closest")[1];
-                idxT0 = impVolSurfaceSet[1].find(log(hPricer0.getVariable("maturity")),"closest")[1];
-                idxT1 = impVolSurfaceSet[1].find(log(hPricer1.getVariable("maturity")),"closest")[1];
-                setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT,idxK));
-                hPricer0.setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT0,idxK0));
-                hPricer1.setVariable("volatility",impVolSurfaceSet[2].getEntry(idxT1,idxK1));
+                idxT = impVolSurfaceSet[1].find(log(getVariable(MATURITY)),"closest")[1];
+                idxT0 = impVolSurfaceSet[1].find(log(hPricer0.getVariable(MATURITY)),"closest")[1];
+                idxT1 = impVolSurfaceSet[1].find(log(hPricer1.getVariable(MATURITY)),"closest")[1];
+                setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT,idxK));
+                hPricer0.setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT0,idxK0));
+                hPricer1.setVariable(VOLATILITY,impVolSurfaceSet[2].getEntry(idxT1,idxK1));
             }
             double O01 = hPricer0.calcPrice("Closed Form");
             double O11 = hPricer1.calcPrice("Closed Form");
@@ -1601,8 +2707,7 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
             stratNOptions[1].setEntry(n,i,nOption1);
             stratHModPrices[0].setEntry(n,i,O01);
             stratHModPrices[1].setEntry(n,i,O11);
-            if(GUI) cout << "[" << getCurrentTime() << "] simulation " <<
-                i+1 << "/" << numSim << " completes" << endl;
+            if(GUI) logMessage(LOG_INFO,"simulation {}/{} completes",i+1,numSim);
         }
     }
     vector<matrix> results{
@@ -1626,3 +2731,65 @@ Backtest Pricer::runBacktest(const SimulationConfig& config, int numSim,
     
 }
 
+
+matrix Pricer::benchmarkPathLayouts(const vector<int>& numSims, int iters, int numRuns, double maxBytes){
+    // seconds per MonteCarloPricer call, best of numRuns, for an up-and-out Barrier and an arithmetic Asian call
+    // under each path layout; rows are option by layout, columns the path counts; the layouts that hold every
+    // path are skipped (NAN) when those would take more than maxBytes
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    vector<Option> options{
+        Option("Barrier","Call",100,1,{130,0},{"Up-and-Out"}),
+        Option("Asian","Call",100,1,{},{"Arithmetic"})
+    };
+    vector<string> layouts{"time-major","path-major","tiled"};
+    matrix seconds((int)(options.size()*layouts.size()),(int)numSims.size());
+    for(int o=0; o<(int)options.size(); o++){
+        Pricer pricer(options[o],market);
+        for(int l=0; l<(int)layouts.size(); l++){
+            SimulationConfig config(1,iters);
+            config.pathLayout = layouts[l];
+            config.seed = 1;
+            for(int k=0; k<(int)numSims.size(); k++){
+                double best = NAN, value = NAN;
+                if(layouts[l]=="tiled" || 8.*(iters+1)*numSims[k]<=maxBytes){
+                    best = INFINITY;
+                    for(int run=0; run<numRuns; run++){
+                        auto t0 = chrono::steady_clock::now();
+                        value = pricer.MonteCarloPricer(config,numSims[k]);
+                        best = min(best,chrono::duration<double>(chrono::steady_clock::now()-t0).count());
+                    }
+                }
+                seconds.setEntry(o*(int)layouts.size()+l,k,best);
+                if(GUI) logMessage(LOG_INFO,"Pricer::benchmarkPathLayouts {} {} paths, {} steps, layout {}: {}s (price {})",
+                                   options[o].getType(),numSims[k],iters,layouts[l],best,value);
+            }
+        }
+    }
+    return seconds;
+}
+
+vector<matrix> Pricer::benchmarkBinomialTree(const vector<int>& steps, int numRuns){
+    // |error| against BlackScholesClosedForm and seconds per call, best of numRuns, of each lattice method on a
+    // European put; returns {errors, seconds}, rows are the methods CRR, LR, BBS, BBSR, LRR and columns the steps
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    Pricer pricer(Option("European","Put",100,1),market);
+    double exact = pricer.BlackScholesClosedForm();
+    vector<string> methods{"CRR","LR","BBS","BBSR","LRR"};
+    matrix errors((int)methods.size(),(int)steps.size()), seconds((int)methods.size(),(int)steps.size());
+    for(int l=0; l<(int)methods.size(); l++){
+        for(int k=0; k<(int)steps.size(); k++){
+            SimulationConfig config(1,steps[k]);
+            double best = INFINITY, value = NAN;
+            for(int run=0; run<numRuns; run++){
+                auto t0 = chrono::steady_clock::now();
+                value = pricer.BinomialTreePricer(config,methods[l]);
+                best = min(best,chrono::duration<double>(chrono::steady_clock::now()-t0).count());
+            }
+            errors.setEntry(l,k,fabs(value-exact));
+            seconds.setEntry(l,k,best);
+            if(GUI) logMessage(LOG_INFO,"Pricer::benchmarkBinomialTree {} {} steps: error {}, {}s",
+                               methods[l],steps[k],errors.getEntry(l,k),best);
+        }
+    }
+    return {errors,seconds};
+}
@@ -16,6 +16,54 @@
 
 using namespace std;
 
+#define LSM_CHUNK 1024
+
+// typed handles for the string keys of getVariable/setVariable, resolved once by Pricer::parseVariable
+enum PricerVariable {CURRENT_PRICE, DRIFT_RATE, DIVIDEND_YIELD, VOLATILITY, CORRELATION,
+                     RISK_FREE_RATE, STRIKE, MATURITY, UNKNOWN_VARIABLE};
+
+// price with its full set of sensitivities, theta and charm are derivatives in calendar time
+struct Greeks{
+    double price, delta, gamma, vega, rho, theta, vanna, volga, charm;
+};
+const Greeks NULL_GREEKS = {NAN,NAN,NAN,NAN,NAN,NAN,NAN,NAN,NAN};
+
+// inputs of a single-stock price, R is double or an AD scalar of autodiff.cpp
+template <class R>
+struct PricingInputs{
+    R S0, K, T, r, q, sig;
+};
+// order of the derivatives returned by Pricer::calcPriceGradient, as in PricingInputs
+const vector<PricerVariable> AD_VARIABLES = {CURRENT_PRICE, STRIKE, MATURITY, RISK_FREE_RATE, DIVIDEND_YIELD, VOLATILITY};
+
+class RiskBump{
+    // one finite-difference sensitivity: central first or second difference of the price in var
+public:
+    PricerVariable var;
+    int derivOrder;
+    double eps; // relative bump size, absolute when the variable is zero
+    int i, j; // stock and correlation indices as in Pricer::getVariable
+    RiskBump(PricerVariable var=CURRENT_PRICE, int derivOrder=1, double eps=1e-2, int i=-1, int j=-1):
+    var(var),derivOrder(derivOrder),eps(eps),i(i),j(j){}
+};
+
+class PriceGrid{
+    // finished grid of Pricer::BlackScholesPDESolverWithFullCalc, prices over log price (cols) and
+    // calendar time (rows); answers price and greeks at any (S,t) on it without another solve
+public:
+    matrix spaceGrids, timeGrids, priceMatrix;
+    /**** constructors ****/
+    PriceGrid(){};
+    PriceGrid(const vector<matrix>& fullCalc);
+    /**** accessors ****/
+    bool isEmpty() const {return priceMatrix.isEmpty();}
+    /**** main ****/
+    double calcPrice(double S, double t=0) const;
+    Greeks calcGreeks(double S, double t=0) const;
+};
+
+class PriceCache;
+
 //const Stock NULL_STOCK;
 //const SimulationConfig NULL_CONFIG;
 
@@ -24,6 +72,9 @@ private:
     Option option, option_orig;
     Market market, market_orig;
     double price;
+    Greeks simGreeks = NULL_GREEKS, simGreekErrs = NULL_GREEKS; // estimated on the last Monte Carlo paths
+    shared_ptr<PriceCache> cache; // optional, shared by copies of the pricer
+    double latticeNodes = 0; // nodes visited by _BinomialTreePricer since the count was last reset
 public:
     vector<double> tmp; // tmp variable log
     /**** constructors ****/
@@ -33,43 +84,80 @@ public:
     Option getOption() const {return option;}
     Market getMarket() const {return market;}
     double getPrice() const {return price;}
+    Greeks getSimGreeks() const {return simGreeks;}
+    Greeks getSimGreekErrs() const {return simGreekErrs;}
+    shared_ptr<PriceCache> getPriceCache() const {return cache;}
     string getAsJson() const;
     double getVariable(string var, int i=-1, int j=-1) const;
+    double getVariable(PricerVariable var, int i=-1, int j=-1) const;
+    static PricerVariable parseVariable(string var);
+    PricingInputs<double> getPricingInputs() const;
     /**** mutators ****/
-    double setVariable(string var, double v, int i=-1);
+    double setVariable(string var, double v, int i=-1, int j=-1);
+    double setVariable(PricerVariable var, double v, int i=-1, int j=-1);
     string setStringVariable(string var, string v);
+    shared_ptr<PriceCache> setPriceCache(shared_ptr<PriceCache> cache){return this->cache = cache;}
     Pricer setVariablesFromFile(string file);
     Pricer resetOriginal();
     Pricer saveAsOriginal();
     /**** main ****/
     double BlackScholesClosedForm();
-    double BinomialTreePricer(const SimulationConfig& config);
+    template <class R> static R BlackScholesFormula(OptionType type, PutCall putCall, const PricingInputs<R>& in);
+    template <class R> R _BinomialTreePricer(int n, string method, const PricingInputs<R>& in);
+    template <class R> R _BinomialTreeValue(const SimulationConfig& config, string method, const PricingInputs<R>& in);
+    double BinomialTreePricer(const SimulationConfig& config, string method="CRR");
     double MonteCarloPricer(const SimulationConfig& config, int numSim, string method="simple");
+    bool _MonteCarloGreeksBlock(const Stock& stock, const SimulationConfig& config, const PathBlock& block,
+                                const double *payoffs, const matrix& simTimeVector, vector<double>& sums);
+    vector<double> _LongstaffSchwartzPricer(const Stock& stock, const SimulationConfig& config, int numSim,
+                                            const PathBuffer *paths=NULL, const vector<double>& cvPayoffs={}, double cvMean=NAN);
     double MultiStockMonteCarloPricer(const SimulationConfig& config, int numSim, string method="simple");
     double NumIntegrationPricer(double z=5, double dz=1e-3);
     double BlackScholesPDESolver(const SimulationConfig& config, int numSpace, string method="implicit");
     vector<matrix> BlackScholesPDESolverWithFullCalc(const SimulationConfig& config, int numSpace, string method="implicit");
+    PriceGrid BlackScholesPDEGrid(const SimulationConfig& config, int numSpace, string method="implicit");
+    Greeks BlackScholesPDEGreeks(const SimulationConfig& config, int numSpace, string method="implicit");
+    template <class R> static void _BlackScholesPDEStep(vector<R>& v, const R& a, const R& b, const R& c,
+                                                         const R& u0, const R& u1, string method, vector<R>& factors);
+    template <class R> R _BlackScholesPDEValue(const SimulationConfig& config, int numSpace, string method,
+                                               const PricingInputs<R>& in);
     vector<double> _FourierInversionPricer(const function<complx(complx)>& charFunc, int numSpace, double rightLim=INF, string method="RN Prob");
     vector<matrix> _fastFourierInversionPricer(const function<complx(complx)>& charFunc, int numSpace, double rightLim=INF);
     double FourierInversionPricer(int numSpace, double rightLim=INF, string method="RN Prob");
+    string _cacheKey(string calc, const SimulationConfig& config, int numSim, int numSpace, double eps=0) const;
+    bool _isReproducible(const SimulationConfig& config) const;
     double calcPrice(string method="Closed Form", const SimulationConfig& config=NULL_CONFIG,
                      int numSim=0, int numSpace=0);
+    template <class R> R _calcPrice(string method, const SimulationConfig& config, int numSpace, const PricingInputs<R>& in);
+    vector<double> calcPriceGradient(string method="Closed Form", string mode="Adjoint",
+                                     const SimulationConfig& config=NULL_CONFIG, int numSpace=0);
+    void _forEachPoint(int numPoints, const function<void(Pricer&,int)>& f, int numThreads) const;
     matrix varyPriceWithVariable(string var, const matrix& varVector,
                                  string method="Closed Form", const SimulationConfig& config=NULL_CONFIG, int numSim=0);
+    static Greeks BlackScholesGreeks(OptionType type, PutCall putCall,
+                                     double S0, double K, double T, double r, double q, double sig);
+    Greeks ClosedFormGreeks() const;
     double ClosedFormGreek(string var, int derivOrder=1);
     double FiniteDifferenceGreek(string var, int derivOrder=1, string method="Closed Form",
                                  const SimulationConfig& config=NULL_CONFIG, int numSim=0, double eps=1e-5);
     double calcGreek(string greekName, string greekMethod="Closed Form", string method="Closed Form",
                      const SimulationConfig& config=NULL_CONFIG, int numSim=0, double eps=1e-5);
+    Greeks calcGreeks(string greekMethod="Closed Form", string method="Closed Form",
+                      const SimulationConfig& config=NULL_CONFIG, int numSim=0, double eps=1e-5);
+    vector<RiskBump> getRiskLadder() const;
+    vector<double> calcSensitivities(const vector<RiskBump>& bumps, string method="Closed Form",
+                                     const SimulationConfig& config=NULL_CONFIG, int numSim=0, int numSpace=0, int numThreads=0);
     matrix varyGreekWithVariable(string var, const matrix& varVector,
                                  string greekName, string greekMethod="Closed Form", string method="Closed Form",
                                  const SimulationConfig& config=NULL_CONFIG, int numSim=0, double eps=1e-5);
     matrix generatePriceSurface(const matrix& stockPriceVector, const matrix& optionTermVector,
                                 string method="Closed Form", const SimulationConfig& config=NULL_CONFIG, int numSim=0);
     bool satisfyPriceBounds(double optionMarketPrice);
+    static double BlackScholesImpliedVolatility(PutCall putCall, double optionPrice,
+                                                double S0, double K, double T, double r, double q, double eps=1e-15);
     double calcImpliedVolatility(double optionMarketPrice, double vol0=5, double eps=1e-5);
-    void generateImpliedVolSurfaceFromFile(string input, string file, double vol0=5, double eps=1e-5);
-    void generateGreeksFromImpliedVolFile(string input, string file);
+    void generateImpliedVolSurfaceFromFile(string input, string file, double vol0=5, double eps=1e-5, int numThreads=0);
+    void generateGreeksFromImpliedVolFile(string input, string file, int numThreads=0);
     vector<matrix> modelImpliedVolSurface(const SimulationConfig& config, int numSpace,
                                           const function<double(double)>& impVolFunc0, const function<double(double)>& impVolFunc1,
                                           double lambdaT, double eps=1e-5);
@@ -78,6 +166,9 @@ public:
                          string strategy="simple-delta", int hedgeFreq=1, double mktImpVol=0, double mktPrice=0,
                          const vector<double>& stratParams={}, const vector<Option>& hOptions={}, const vector<matrix>& impVolSurfaceSet={},
                          string simPriceMethod="model", const matrix& stockPriceSeries=NULL_VECTOR);
+    static matrix benchmarkPathLayouts(const vector<int>& numSims={100000,1000000,10000000}, int iters=64,
+                                       int numRuns=1, double maxBytes=4e9);
+    static vector<matrix> benchmarkBinomialTree(const vector<int>& steps={25,50,100,200,500,1000,2000,5000}, int numRuns=5);
     /**** operators ****/
     friend ostream& operator<<(ostream& out, const Pricer& pricer);
 };
@@ -13,9 +13,19 @@ using namespace std;
 string SimulationConfig::getAsJson() const {
     ostringstream oss;
     oss << "{" <<
-    "\"iters\":"    << iters    << "," <<
-    "\"endTime\":"  << endTime  << "," <<
-    "\"stepSize\":" << stepSize <<
+    "\"iters\":"        << iters        << "," <<
+    "\"endTime\":"      << endTime      << "," <<
+    "\"stepSize\":"     << stepSize     << "," <<
+    "\"pathLayout\":\"" << pathLayout   << "\"," <<
+    "\"tilePaths\":"    << tilePaths    << "," <<
+    "\"seed\":"         << seed         << "," <<
+    "\"numThreads\":"   << numThreads   << "," <<
+    "\"barrierCorrection\":\"" << barrierCorrection << "\"," <<
+    "\"lsmBasis\":\""   << lsmBasis     << "\"," <<
+    "\"lsmDegree\":"     << lsmDegree    << "," <<
+    "\"lsmBoundPaths\":" << lsmBoundPaths << "," <<
+    "\"lsmInnerPaths\":" << lsmInnerPaths << "," <<
+    "\"simGreeks\":"   << (simGreeks?"true":"false") <<
     "}";
     return oss.str();
 }
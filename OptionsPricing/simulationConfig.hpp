@@ -16,6 +16,16 @@ class SimulationConfig{
 public:
     int iters;
     double endTime, stepSize;
+    string pathLayout = "time-major"; // "time-major", "path-major" or "tiled"
+    int tilePaths = 0; // paths per tile for "tiled", 0 sizes tiles to L2
+    unsigned long seed = 0; // seed for the seeded engines (threaded and single-stock paths), 0 draws from rand()
+    int numThreads = 0; // worker threads for threaded engines, 0 uses all cores
+    string barrierCorrection = "none"; // "bridge" or "BGK" for continuously monitored barriers
+    string lsmBasis = "Laguerre"; // Longstaff-Schwartz regression basis, "Laguerre" or "monomial"
+    int lsmDegree = 3; // highest polynomial degree of the regression basis
+    int lsmBoundPaths = 0; // independent paths for the low/high-biased bounds, 0 skips them
+    int lsmInnerPaths = 0; // inner paths per exercise date for the dual upper bound, 0 skips it
+    bool simGreeks = false; // also estimate delta, gamma, vega and rho on the Monte Carlo pricing paths
     SimulationConfig(double t=0, int n=1):endTime(t),iters(n),stepSize(t/n){}
     bool isEmpty() const {return endTime==0;}
     string getAsJson() const;
@@ -33,6 +33,9 @@ Stock::Stock(const Stock& stock){
     this->dynParams = stock.dynParams;
     this->dynamics = stock.dynamics;
     this->name = stock.name;
+    this->simTimeVectorPtr = stock.simTimeVectorPtr;
+    this->simPriceMatrixPtr = stock.simPriceMatrixPtr;
+    this->binomialPriceTreePtr = stock.binomialPriceTreePtr;
 }
 
 string Stock::getAsJson() const {
@@ -84,14 +87,15 @@ vector<double> Stock::setDynParams(const vector<double>& dynParams){
     return dynParams;
 }
 
-matrix Stock::setSimTimeVector(const matrix& simTimeVector){
-    this->simTimeVector = simTimeVector;
-    return simTimeVector;
+const matrix& Stock::setSimTimeVector(const matrix& simTimeVector){
+    // a new snapshot, copies of this stock keep the previous one
+    this->simTimeVectorPtr = make_shared<matrix>(simTimeVector);
+    return *simTimeVectorPtr;
 }
 
-matrix Stock::setSimPriceMatrix(const matrix& simPriceMatrix){
-    this->simPriceMatrix = simPriceMatrix;
-    return simPriceMatrix;
+const matrix& Stock::setSimPriceMatrix(const matrix& simPriceMatrix){
+    this->simPriceMatrixPtr = make_shared<matrix>(simPriceMatrix);
+    return *simPriceMatrixPtr;
 }
 
 double Stock::estDriftRateFromPrice(const matrix& priceSeries, double dt, string method){
@@ -196,8 +200,8 @@ vector<matrix> Stock::simulatePriceWithFullCalc_loop(const SimulationConfig& con
             }
             simTimeVector_[i] = i*dt;
         }
-        simTimeVector = matrix(1,n+1,simTimeVector_);
-        simPriceMatrix = matrix(n+1,m,simPriceMatrix_);
+        setSimTimeVector(matrix(1,n+1,simTimeVector_));
+        const matrix& simPriceMatrix = setSimPriceMatrix(matrix(n+1,m,simPriceMatrix_));
         matrix simVolMatrix = matrix(n+1,m,simVolMatrix_);
         matrix simVarMatrix = matrix(n+1,m,simVarMatrix_);
         delete[] simTimeVector_;
@@ -206,8 +210,8 @@ vector<matrix> Stock::simulatePriceWithFullCalc_loop(const SimulationConfig& con
         delete[] simVarMatrix_;
         return {simPriceMatrix,simVolMatrix,simVarMatrix};
     }
-    simTimeVector = matrix(1,n+1,simTimeVector_);
-    simPriceMatrix = matrix(n+1,m,simPriceMatrix_);
+    setSimTimeVector(matrix(1,n+1,simTimeVector_));
+    const matrix& simPriceMatrix = setSimPriceMatrix(matrix(n+1,m,simPriceMatrix_));
     delete[] simTimeVector_;
     delete[] simPriceMatrix_;
     return {simPriceMatrix};
@@ -219,8 +223,8 @@ vector<matrix> Stock::simulatePriceWithFullCalc(const SimulationConfig& config,
     double sqrt_dt = sqrt(dt);
     matrix randomVector(1,numSim);
     matrix simPriceVector(1,numSim,currentPrice);
-    simTimeVector = matrix(1,n+1);
-    simPriceMatrix = matrix(n+1,numSim);
+    matrix simTimeVector(1,n+1);
+    matrix simPriceMatrix(n+1,numSim);
     simPriceMatrix.setRow(0,simPriceVector);
     simTimeVector.setEntry(0,0,0);
     if(dynamics=="lognormal"){
@@ -250,6 +254,8 @@ vector<matrix> Stock::simulatePriceWithFullCalc(const SimulationConfig& config,
             simJmpMatrix.setRow(i,jmpRandomVector);
             simTimeVector.setEntry(0,i,i*dt);
         }
+        setSimTimeVector(simTimeVector);
+        setSimPriceMatrix(simPriceMatrix);
         return {simPriceMatrix,simPoiMatrix,simJmpMatrix};
     }else if(dynamics=="Heston"){
         double sig0             = volatility;
@@ -279,6 +285,8 @@ vector<matrix> Stock::simulatePriceWithFullCalc(const SimulationConfig& config,
             simVarMatrix.setRow(i,currentVar);
             simTimeVector.setEntry(0,i,i*dt);
         }
+        setSimTimeVector(simTimeVector);
+        setSimPriceMatrix(simPriceMatrix);
         return {simPriceMatrix,simVolMatrix,simVarMatrix};
     }else if(dynamics=="GARCH"){
         double sig0             = volatility;
@@ -306,6 +314,8 @@ vector<matrix> Stock::simulatePriceWithFullCalc(const SimulationConfig& config,
             simVarMatrix.setRow(i,currentVar);
             simTimeVector.setEntry(0,i,i*dt);
         }
+        setSimTimeVector(simTimeVector);
+        setSimPriceMatrix(simPriceMatrix);
         return {simPriceMatrix,simVolMatrix,simVarMatrix};
     }else if(dynamics=="CEV"){
         double gamma = dynParams[0];
@@ -317,28 +327,162 @@ vector<matrix> Stock::simulatePriceWithFullCalc(const SimulationConfig& config,
             simTimeVector.setEntry(0,i,i*dt);
         }
     }
+    setSimTimeVector(simTimeVector);
+    setSimPriceMatrix(simPriceMatrix);
     return {simPriceMatrix};
 }
 
-matrix Stock::bootstrapPrice(const matrix& priceSeries, const SimulationConfig& config, int numSim){
+PathBuffer Stock::simulatePricePaths(const SimulationConfig& config, int numSim){
     int n = config.iters;
     double dt = config.stepSize;
-    matrix simPriceVector(1,numSim,currentPrice);
-    matrix returnSeries, bootReturnSeries;
-    simTimeVector = matrix(1,n+1);
-    simPriceMatrix = matrix(n+1,numSim);
-    simPriceMatrix.setRow(0,simPriceVector);
-    simTimeVector.setEntry(0,0,0);
-    returnSeries =
-    (priceSeries.submatrix(1,-1,"col")-priceSeries.submatrix(0,-2,"col"))
-    /priceSeries.submatrix(0,-2,"col");
-    for(int i=1; i<n+1; i++){
-        bootReturnSeries = returnSeries.sample(numSim,true);
-        simPriceVector += simPriceVector*bootReturnSeries;
-        simPriceMatrix.setRow(i,simPriceVector);
-        simTimeVector.setEntry(0,i,i*dt);
+    PathBuffer simPaths(n+1,numSim,config.pathLayout,config.tilePaths);
+    bool generated = true;
+    for(int b=0; b<simPaths.getNumBlocks() && generated; b++)
+        generated = simulatePriceBlock(config,simPaths.getBlock(b));
+    if(!generated) simPaths = PathBuffer(simulatePrice(config,numSim),config.pathLayout,config.tilePaths);
+    setSimTimeVector(matrix().setRange(0,n*dt,n,true));
+    return simPaths;
+}
+
+bool Stock::simulatePriceBlock(const SimulationConfig& config, const PathBlock& block){
+    // fill block in place, streaming along its contiguous dimension
+    // with config.seed set the normals come from a generator seeded by (seed, first path), so that the
+    // same seed reproduces the same paths in any thread, otherwise from the global normalRand_
+    int n = block.steps;
+    int w = block.width;
+    int ss = block.stepStride, ps = block.pathStride;
+    double *S = block.data;
+    double dt = config.stepSize;
+    double sqrt_dt = sqrt(dt);
+    double mult0 = 1+driftRate*dt;
+    bool seeded = config.seed!=0;
+    mt19937_64 gen = seeded?randomEngine(config.seed,block.path0):mt19937_64();
+    normal_distribution<double> normal;
+    auto draw = [&](){return seeded?normal(gen):normalRand_();};
+    if(dynamics=="lognormal"){
+        double mult1 = volatility*sqrt_dt;
+        if(ps==1){
+            for(int j=0; j<w; j++) S[j] = currentPrice;
+            for(int i=1; i<n; i++){
+                double *S0 = S+(i-1)*ss, *S1 = S+i*ss;
+                for(int j=0; j<w; j++) S1[j] = S0[j]*(mult0+mult1*draw());
+            }
+        }else{
+            for(int j=0; j<w; j++){
+                double *path = S+j*ps;
+                path[0] = currentPrice;
+                for(int i=1; i<n; i++) path[i] = path[i-1]*(mult0+mult1*draw());
+            }
+        }
+        return true;
+    }else if(dynamics=="Heston"){
+        double sig0             = volatility;
+        double reversionRate    = dynParams[0];
+        double longRunVar       = dynParams[1];
+        double volOfVol         = dynParams[2];
+        double brownianCor0     = dynParams[3];
+        double brownianCor1     = sqrt(1-brownianCor0*brownianCor0);
+        double var0 = sig0*sig0;
+        if(ps==1){
+            vector<double> currentVar(w,var0);
+            for(int j=0; j<w; j++) S[j] = currentPrice;
+            for(int i=1; i<n; i++){
+                double *S0 = S+(i-1)*ss, *S1 = S+i*ss;
+                for(int j=0; j<w; j++){
+                    double r0 = draw();
+                    double r1 = draw();
+                    double &v = currentVar[j];
+                    v += reversionRate*(longRunVar-v)*dt+volOfVol*sqrt(v)*sqrt_dt*(brownianCor0*r0+brownianCor1*r1);
+                    v  = max(v,0.);
+                    S1[j] = S0[j]*(mult0+sqrt(v)*sqrt_dt*r0);
+                }
+            }
+        }else{
+            for(int j=0; j<w; j++){
+                double *path = S+j*ps;
+                double v = var0;
+                path[0] = currentPrice;
+                for(int i=1; i<n; i++){
+                    double r0 = draw();
+                    double r1 = draw();
+                    v += reversionRate*(longRunVar-v)*dt+volOfVol*sqrt(v)*sqrt_dt*(brownianCor0*r0+brownianCor1*r1);
+                    v  = max(v,0.);
+                    path[i] = path[i-1]*(mult0+sqrt(v)*sqrt_dt*r0);
+                }
+            }
+        }
+        return true;
     }
-    return simPriceMatrix;
+    return false;
+}
+
+matrix Stock::bootstrapPrice(const matrix& priceSeries, const SimulationConfig& config, int numSim,
+                             string method, int blockLength){
+    return setSimPriceMatrix(bootstrapPricePaths(priceSeries,config,numSim,method,blockLength).toMatrix());
+}
+
+PathBuffer Stock::bootstrapPricePaths(const matrix& priceSeries, const SimulationConfig& config, int numSim,
+                                      string method, int blockLength){
+    // resample historical returns: "iid", "moving-block" (fixed length blocks)
+    // or "stationary" (geometric block lengths with mean blockLength, Politis-Romano)
+    int n = config.iters;
+    double dt = config.stepSize;
+    int N = priceSeries.getCols()-1;
+    if(N<1) return PathBuffer(); // no return to resample
+    vector<double> growth(N);
+    for(int k=0; k<N; k++)
+        growth[k] = priceSeries.getEntry(0,k+1)/priceSeries.getEntry(0,k);
+    if(blockLength<=0) blockLength = max((int)round(cbrt(N)),1);
+    blockLength = min(blockLength,N);
+    double restartProb = 1./blockLength;
+    bool movingBlock = method=="moving-block", stationary = method=="stationary";
+    unsigned long seed = config.seed?config.seed:rand();
+    PathBuffer simPaths(n+1,numSim,config.pathLayout,config.tilePaths);
+    int numChunks = (numSim+BOOTSTRAP_CHUNK-1)/BOOTSTRAP_CHUNK;
+    parallelFor(numChunks,[&](int c){
+        // index streams for the chunk, drawn path by path, stored step-major
+        int j0 = c*BOOTSTRAP_CHUNK, j1 = min(j0+BOOTSTRAP_CHUNK,numSim), w = j1-j0;
+        mt19937_64 gen = randomEngine(seed,c);
+        uniform_int_distribution<int> anyReturn(0,N-1), blockStart(0,N-blockLength);
+        uniform_real_distribution<double> unif(0,1);
+        vector<int> idx((size_t)n*w);
+        for(int j=0; j<w; j++){
+            int k = 0;
+            for(int i=0; i<n; i++){
+                if(movingBlock)
+                    k = (i%blockLength==0)?blockStart(gen):k+1;
+                else if(stationary)
+                    k = (i==0 || unif(gen)<restartProb)?anyReturn(gen):(k+1)%N;
+                else k = anyReturn(gen);
+                idx[(size_t)i*w+j] = k;
+            }
+        }
+        // apply to each block segment overlapping the chunk
+        for(int b=0; b<simPaths.getNumBlocks(); b++){
+            PathBlock block = simPaths.getBlock(b);
+            int p0 = max(j0,block.path0), p1 = min(j1,block.path0+block.width);
+            if(p0>=p1) continue;
+            int ss = block.stepStride, ps = block.pathStride;
+            double *S = block.data+(size_t)(p0-block.path0)*ps;
+            const int *I = idx.data()+(p0-j0);
+            if(ps==1){
+                for(int j=0; j<p1-p0; j++) S[j] = currentPrice;
+                for(int i=1; i<n+1; i++){
+                    double *S0 = S+(size_t)(i-1)*ss, *S1 = S+(size_t)i*ss;
+                    const int *I0 = I+(size_t)(i-1)*w;
+                    for(int j=0; j<p1-p0; j++) S1[j] = S0[j]*growth[I0[j]];
+                }
+            }else{
+                for(int j=0; j<p1-p0; j++){
+                    double *path = S+(size_t)j*ps;
+                    path[0] = currentPrice;
+                    for(int i=1; i<n+1; i++) path[i] = path[i-1]*growth[I[(size_t)(i-1)*w+j]];
+                }
+            }
+        }
+    },config.numThreads);
+    setSimTimeVector(matrix().setRange(0,n*dt,n,true));
+    return simPaths;
 }
 
 matrix Stock::generatePriceTree(const SimulationConfig& config){
@@ -346,8 +490,8 @@ matrix Stock::generatePriceTree(const SimulationConfig& config){
     double dt = config.stepSize;
     double sqrt_dt = sqrt(dt);
     double u = exp(volatility*sqrt_dt), d = 1/u;
-    simTimeVector = matrix(1,n);
-    binomialPriceTree = matrix(n,n);
+    matrix simTimeVector(1,n);
+    matrix binomialPriceTree(n,n);
     binomialPriceTree.setEntry(0,0,currentPrice);
     simTimeVector.setEntry(0,0,0);
     for(int i=1; i<n; i++){
@@ -356,6 +500,8 @@ matrix Stock::generatePriceTree(const SimulationConfig& config){
         binomialPriceTree.setEntry(i,i,binomialPriceTree.getEntry(i-1,i-1)*u);
         simTimeVector.setEntry(0,i,i*dt);
     }
+    setSimTimeVector(simTimeVector);
+    binomialPriceTreePtr = make_shared<matrix>(binomialPriceTree);
     return binomialPriceTree;
 }
 
@@ -11,18 +11,22 @@
 #include "util.cpp"
 #include "complx.cpp"
 #include "matrix.cpp"
+#include "pathBuffer.hpp"
 
 #include "simulationConfig.hpp"
+#include <memory>
 using namespace std;
 
+#define BOOTSTRAP_CHUNK 512
 
 
 class Stock{
 private:
     string name, dynamics;
     double currentPrice, dividendYield, driftRate, volatility;
-    matrix simTimeVector, simPriceMatrix, binomialPriceTree;
     vector<double> dynParams;
+    // simulation outputs, immutable once set and shared between copies
+    shared_ptr<const matrix> simTimeVectorPtr, simPriceMatrixPtr, binomialPriceTreePtr;
 public:
     /**** constructors ****/
     Stock(){};
@@ -36,9 +40,9 @@ public:
     double getDividendYield() const {return dividendYield;}
     double getDriftRate() const {return driftRate;}
     double getVolatility() const {return volatility;}
-    matrix getSimTimeVector() const {return simTimeVector;}
-    matrix getSimPriceMatrix() const {return simPriceMatrix;}
-    matrix getBinomialPriceTree() const {return binomialPriceTree;}
+    const matrix& getSimTimeVector() const {return simTimeVectorPtr?*simTimeVectorPtr:NULL_MATRIX;}
+    const matrix& getSimPriceMatrix() const {return simPriceMatrixPtr?*simPriceMatrixPtr:NULL_MATRIX;}
+    const matrix& getBinomialPriceTree() const {return binomialPriceTreePtr?*binomialPriceTreePtr:NULL_MATRIX;}
     vector<double> getDynParams() const {return dynParams;}
     string getAsJson() const;
     /**** mutators ****/
@@ -49,8 +53,8 @@ public:
     double setDriftRate(double driftRate);
     double setVolatility(double volatility);
     vector<double> setDynParams(const vector<double>& dynParams);
-    matrix setSimTimeVector(const matrix& simTimeVector);
-    matrix setSimPriceMatrix(const matrix& simPriceMatrix);
+    const matrix& setSimTimeVector(const matrix& simTimeVector);
+    const matrix& setSimPriceMatrix(const matrix& simPriceMatrix);
     double estDriftRateFromPrice(const matrix& priceSeries, double dt, string method="simple");
     double estVolatilityFromPrice(const matrix& priceSeries, double dt, string method="simple");
     /**** main ****/
@@ -60,7 +64,12 @@ public:
     matrix simulatePrice(const SimulationConfig& config, int numSim=1, const matrix& randomMatrix=NULL_MATRIX);
     vector<matrix> simulatePriceWithFullCalc_loop(const SimulationConfig& config, int numSim=1, const matrix& randomMatrix=NULL_MATRIX);
     vector<matrix> simulatePriceWithFullCalc(const SimulationConfig& config, int numSim=1, const matrix& randomMatrix=NULL_MATRIX);
-    matrix bootstrapPrice(const matrix& priceSeries, const SimulationConfig& config, int numSim=1);
+    PathBuffer simulatePricePaths(const SimulationConfig& config, int numSim=1);
+    bool simulatePriceBlock(const SimulationConfig& config, const PathBlock& block);
+    matrix bootstrapPrice(const matrix& priceSeries, const SimulationConfig& config, int numSim=1,
+                          string method="iid", int blockLength=0);
+    PathBuffer bootstrapPricePaths(const matrix& priceSeries, const SimulationConfig& config, int numSim=1,
+                                   string method="iid", int blockLength=0);
     matrix generatePriceTree(const SimulationConfig& config);
     matrix generatePriceMatrixFromTree();
     /**** operators ****/
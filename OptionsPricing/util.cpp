@@ -13,12 +13,17 @@
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
 #include <cassert>
 #include <ctime>
 #include <cmath>
 #include <string>
 #include <vector>
 #include <set>
+#include <random>
+#include <thread>
+#include <atomic>
 using namespace std;
 
 inline void seperator(int length=20){cout << string(length,'-') << endl;}
@@ -30,6 +35,32 @@ inline double normalCDF(double x, double mu=0, double sig=1){return erfc(-M_SQRT
 inline double stdNormalPDF(double x){return normalPDF(x);}
 inline double stdNormalCDF(double x){return normalCDF(x);}
 
+inline int numHardwareThreads(){
+    unsigned k = thread::hardware_concurrency();
+    return k>0?k:1;
+}
+
+inline void parallelFor(int n, const function<void(int)>& f, int numThreads=0){
+    // run f(0),...,f(n-1) on a group of threads pulling work items from a shared counter
+    if(numThreads<=0) numThreads = numHardwareThreads();
+    numThreads = min(numThreads,n);
+    if(numThreads<=1){
+        for(int k=0; k<n; k++) f(k);
+        return;
+    }
+    atomic<int> next(0);
+    vector<thread> pool;
+    for(int t=0; t<numThreads; t++)
+        pool.push_back(thread([&](){for(int k=next++; k<n; k=next++) f(k);}));
+    for(auto& th:pool) th.join();
+}
+
+inline mt19937_64 randomEngine(unsigned long long seed, unsigned long long stream){
+    // independent generator per (seed,stream), reproducible whatever the thread count
+    seed_seq seq{(unsigned)seed,(unsigned)(seed>>32),(unsigned)stream,(unsigned)(stream>>32)};
+    return mt19937_64(seq);
+}
+
 int poissonRand(double lambda=1){
     int n = -1;
     double prod = 1;
@@ -52,6 +83,33 @@ double lognormalPDF(double x, double mu=0, double sig=1){
     return exp(-(log_x-mu)*(log_x-mu)/(2*sig*sig))/(sqrt(2*M_PI)*sig*x);
 }
 
+double normalInvCDF(double p){
+    // Acklam's rational approximation (relative error 1.15e-9) polished by one Halley step on erfc
+    static const double a[] = {-3.969683028665376e+01,2.209460984245205e+02,-2.759285104469687e+02,
+        1.383577518672690e+02,-3.066479806614716e+01,2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01,1.615858368580409e+02,-1.556989798598866e+02,
+        6.680131188771972e+01,-1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03,-3.223964580411365e-01,-2.400758277161838e+00,
+        -2.549732539343734e+00,4.374664141464968e+00,2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03,3.224671290700398e-01,2.445134137142996e+00,
+        3.754408661907416e+00};
+    if(!(p>0)) return (p==0)?-INFINITY:NAN;
+    if(!(p<1)) return (p==1)?INFINITY:NAN;
+    double x, u = min(p,1-p);
+    if(u<0.02425){
+        double t = sqrt(-2*log(u));
+        x = (((((c[0]*t+c[1])*t+c[2])*t+c[3])*t+c[4])*t+c[5])/((((d[0]*t+d[1])*t+d[2])*t+d[3])*t+1);
+        if(p>0.5) x = -x;
+    }else{
+        double t = p-0.5, t2 = t*t;
+        x = (((((a[0]*t2+a[1])*t2+a[2])*t2+a[3])*t2+a[4])*t2+a[5])*t/
+            (((((b[0]*t2+b[1])*t2+b[2])*t2+b[3])*t2+b[4])*t2+1);
+    }
+    double e = (p>0.5)?(1-p)-normalCDF(-x):normalCDF(x)-p; // tail error on the side of p
+    double w = e*sqrt(2*M_PI)*exp(x*x/2);
+    return x-w/(1+x*w/2);
+}
+
 double mathFunc(double x, string type, vector<double> vec){
     double fx = NAN;
     if(type=="const"){
@@ -109,6 +167,76 @@ bool isDouble(string str, double& v) {
     return true;
 }
 
+struct StrView{
+    // characters [begin,end) of a buffer owned elsewhere
+    const char *begin, *end;
+    string str() const {return string(begin,end);}
+};
+
+inline const char* lineEnd(const char *p, const char *end){
+    const char *q = (const char*)memchr(p,'\n',end-p);
+    return q?q:end;
+}
+
+inline int splitFields(const char *begin, const char *end, StrView *fields, int maxFields, char sep=','){
+    // split [begin,end) at sep without copying, the last field keeps the rest of the line as getline does
+    int n = 0;
+    for(const char *q; n<maxFields-1 && (q = (const char*)memchr(begin,sep,end-begin)); begin = q+1)
+        fields[n++] = {begin,q};
+    fields[n++] = {begin,end};
+    return n;
+}
+
+long processLinesInChunks(string input, string output,
+                          const function<long(const char *begin, const char *end, string& out)>& processChunk,
+                          int numThreads=0, size_t chunkSize=1<<22){
+    // read input in blocks of whole lines of about chunkSize bytes, numThreads blocks at a time are processed in
+    // parallel and their outputs written in input order; returns the sum of processChunk or -1 if a file fails
+    FILE *fi = fopen(input.c_str(),"rb"), *fo = fopen(output.c_str(),"wb");
+    if(!fi || !fo){
+        if(fi) fclose(fi);
+        if(fo) fclose(fo);
+        return -1;
+    }
+    if(numThreads<=0) numThreads = numHardwareThreads();
+    vector<string> blocks(numThreads), outs(numThreads);
+    vector<long> counts(numThreads);
+    string carry; // partial last line of the previous block
+    bool eof = false;
+    auto readBlock = [&](string& block){
+        block.swap(carry); carry.clear();
+        while(!eof){
+            size_t n0 = block.size();
+            block.resize(n0+chunkSize);
+            size_t got = fread(&block[n0],1,chunkSize,fi);
+            block.resize(n0+got);
+            eof = got<chunkSize;
+            size_t last = block.rfind('\n');
+            if(!eof && last!=string::npos){
+                carry.assign(block,last+1,string::npos);
+                block.resize(last+1);
+                break;
+            }
+        }
+    };
+    long total = 0;
+    while(!eof){
+        int numBlocks = 0;
+        while(numBlocks<numThreads && !eof) readBlock(blocks[numBlocks++]);
+        parallelFor(numBlocks,[&](int k){
+            outs[k].clear();
+            counts[k] = processChunk(blocks[k].data(),blocks[k].data()+blocks[k].size(),outs[k]);
+        },numThreads);
+        for(int k=0; k<numBlocks; k++){
+            fwrite(outs[k].data(),1,outs[k].size(),fo);
+            total += counts[k];
+        }
+    }
+    fclose(fi);
+    fclose(fo);
+    return total;
+}
+
 string getCurrentTime(){
     time_t t = time(0);
     char time[100];
@@ -5,8 +5,463 @@
 //  Created by Kohsheen Tiku on 1/16/24.
 //
 //
-//#define BOOST_TEST_DYN_LINK
-//#define BOOST_TEST_MODULE OptionPricingTest
-//#include <boost/test/unit_test.hpp>
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE OptionPricingTest
+#include <boost/test/unit_test.hpp>
+#include "../OptionsPricing/pathBuffer.cpp"
+#include "../OptionsPricing/stock.cpp"
+#include "../OptionsPricing/market.cpp"
+#include "../OptionsPricing/pricer.cpp"
+#include "../OptionsPricing/backtest.cpp"
+#include "../OptionsPricing/simulationConfig.cpp"
+#include "../OptionsPricing/batchPricer.cpp"
 
+using namespace std;
 
+/**** helpers ****/
+
+struct ImpliedVolCase{PutCall putCall; double S0, K, T, r, q, sig;};
+
+vector<ImpliedVolCase> impliedVolCases(){
+    // calls and puts across moneyness, maturity and volatility
+    vector<ImpliedVolCase> cases;
+    for(PutCall putCall:{CALL,PUT})
+        for(double K:{50.,80.,95.,100.,105.,125.,200.})
+            for(double T:{0.02,0.25,1.,5.})
+                for(double sig:{0.05,0.2,0.6,1.5})
+                    cases.push_back({putCall,100,K,T,0.03,0.01,sig});
+    return cases;
+}
+
+double blackScholesPrice(const ImpliedVolCase& c, double sig){
+    PricingInputs<double> in = {c.S0,c.K,c.T,c.r,c.q,sig};
+    return Pricer::BlackScholesFormula(EUROPEAN,c.putCall,in);
+}
+
+double timeValue(const ImpliedVolCase& c, double price){
+    // price over the discounted intrinsic value of the forward, the part the volatility is recovered from
+    double F = c.S0*exp((c.r-c.q)*c.T), D = exp(-c.r*c.T);
+    return price-D*max((c.putCall==CALL)?F-c.K:c.K-F,0.);
+}
+
+/**** implied volatility ****/
+
+BOOST_AUTO_TEST_CASE(impliedVolatilityRoundTrip){
+    // price -> implied vol -> price, and the volatility itself wherever the price carries it; a time value
+    // lost in the rounding of the price may give NaN, or any volatility that reprices it
+    for(const ImpliedVolCase& c:impliedVolCases()){
+        double price = blackScholesPrice(c,c.sig);
+        double vol = Pricer::BlackScholesImpliedVolatility(c.putCall,price,c.S0,c.K,c.T,c.r,c.q);
+        if(timeValue(c,price)>1e-6*price){
+            BOOST_REQUIRE(!isnan(vol));
+            BOOST_CHECK_SMALL(vol/c.sig-1,1e-10);
+        }
+        if(!isnan(vol)) BOOST_CHECK_SMALL(blackScholesPrice(c,vol)-price,1e-13*price+1e-14*c.S0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(impliedVolatilityBatchMatchesScalar){
+    // the batch stops its Householder steps earlier than the scalar path, at about 1e-9 in the volatility
+    vector<ImpliedVolCase> cases = impliedVolCases();
+    BatchPricer batch(EUROPEAN,(int)cases.size());
+    vector<double> prices;
+    for(const ImpliedVolCase& c:cases){
+        batch.addOption(c.S0,c.K,c.T,c.r,c.q,c.sig,c.putCall==CALL);
+        prices.push_back(blackScholesPrice(c,c.sig));
+    }
+    vector<double> vols = batch.calcImpliedVolatilities(prices);
+    BOOST_REQUIRE_EQUAL(vols.size(),cases.size());
+    for(size_t k=0; k<cases.size(); k++){
+        const ImpliedVolCase& c = cases[k];
+        double vol = Pricer::BlackScholesImpliedVolatility(c.putCall,prices[k],c.S0,c.K,c.T,c.r,c.q);
+        if(timeValue(c,prices[k])>1e-6*prices[k]) BOOST_CHECK_SMALL(vols[k]/vol-1,1e-8);
+        if(!isnan(vols[k])) BOOST_CHECK_SMALL(blackScholesPrice(c,vols[k])-prices[k],1e-13*prices[k]+1e-14*c.S0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(impliedVolatilityOutsideBounds){
+    // no volatility below the intrinsic value of the forward or above the discounted stock (call) / strike (put)
+    double S0 = 100, K = 90, T = 1, r = 0.03, q = 0.01;
+    double F = S0*exp((r-q)*T), D = exp(-r*T);
+    double callLow = D*(F-K), callHigh = S0*exp(-q*T), putLow = 0, putHigh = D*K;
+    vector<pair<PutCall,double>> prices{
+        {CALL,callLow*0.99}, {CALL,callLow}, {CALL,callHigh}, {CALL,callHigh*1.01},
+        {PUT,putLow}, {PUT,-1}, {PUT,putHigh}, {PUT,putHigh*1.01}
+    };
+    BatchPricer batch(EUROPEAN,(int)prices.size());
+    vector<double> batchPrices;
+    for(auto& p:prices){
+        BOOST_CHECK(isnan(Pricer::BlackScholesImpliedVolatility(p.first,p.second,S0,K,T,r,q)));
+        batch.addOption(S0,K,T,r,q,0.2,p.first==CALL);
+        batchPrices.push_back(p.second);
+    }
+    for(double vol:batch.calcImpliedVolatilities(batchPrices)) BOOST_CHECK(isnan(vol));
+}
+
+/**** American put ****/
+
+BOOST_AUTO_TEST_CASE(americanPutLattices){
+    // the Richardson lattices at 200 steps agree with CRR at 5000 steps, and early exercise is worth something
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    Pricer pricer(Option("American","Put",100,1),market);
+    double reference = pricer.BinomialTreePricer(SimulationConfig(1,5000));
+    for(string method:{"BBSR","LRR"})
+        BOOST_CHECK_SMALL(pricer.BinomialTreePricer(SimulationConfig(1,200),method)-reference,1e-3);
+    double european = Pricer(Option("European","Put",100,1),market).BlackScholesClosedForm();
+    BOOST_CHECK_GT(reference,european);
+}
+
+BOOST_AUTO_TEST_CASE(binomialTreeSingleStep){
+    // the Richardson methods have no coarser lattice at one step and fall back to BBS and LR
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    for(string type:{"European","American"}){
+        Pricer pricer(Option(type,"Put",100,1),market);
+        SimulationConfig config(1,1);
+        BOOST_CHECK_EQUAL(pricer.BinomialTreePricer(config,"BBSR"),pricer.BinomialTreePricer(config,"BBS"));
+        BOOST_CHECK_EQUAL(pricer.BinomialTreePricer(config,"LRR"),pricer.BinomialTreePricer(config,"LR"));
+        BOOST_CHECK(!isnan(pricer.BinomialTreePricer(config,"LRR")));
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(binomialTreeCoarseSteps){
+    // a CRR up probability outside [0,1] gives NaN with a warning, enough steps bring it back inside
+    Market market(0.5,Stock(100,0,0.05,0.05));
+    Pricer pricer(Option("European","Put",100,1),market);
+    ostringstream out;
+    Logger::global().setOutput(&out);
+    double coarse = pricer.BinomialTreePricer(SimulationConfig(1,2));
+    Logger::global().flush();
+    Logger::global().setOutput(&cout);
+    BOOST_CHECK(isnan(coarse));
+    BOOST_CHECK(out.str().find("[warn] _BinomialTreePricer: CRR up probability")!=string::npos);
+    BOOST_CHECK_SMALL(pricer.BinomialTreePricer(SimulationConfig(1,2000))-pricer.BlackScholesClosedForm(),1e-6);
+}
+
+/**** model implied vol surface ****/
+
+BOOST_AUTO_TEST_CASE(modelImpliedVolSurfaceConverges){
+    // constant boundary values give a constant surface, and in general every interior node is the average
+    // of its four neighbours to within the stopping tolerance
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    Pricer pricer(Option("European","Call",100,1),market);
+    SimulationConfig config(1,40);
+    auto flat = [](double x){return 0.2;};
+    matrix surface = pricer.modelImpliedVolSurface(config,40,flat,flat,0.5,1e-10)[2];
+    for(int i=0; i<surface.getRows(); i++)
+        for(int j=0; j<surface.getCols(); j++) BOOST_CHECK_SMALL(surface.getEntry(i,j)-0.2,1e-9);
+    auto smile0 = [](double x){return 0.2+0.1*(x-log(100))*(x-log(100));};
+    auto smile1 = [](double x){return 0.25+0.05*(x-log(100))*(x-log(100));};
+    surface = pricer.modelImpliedVolSurface(config,40,smile0,smile1,0.5,1e-10)[2];
+    double scale = 0, res = 0;
+    for(int i=0; i<surface.getRows(); i++)
+        for(int j=0; j<surface.getCols(); j++) scale = max(scale,fabs(surface.getEntry(i,j)));
+    for(int i=1; i<surface.getRows()-1; i++)
+        for(int j=1; j<surface.getCols()-1; j++)
+            res = max(res,fabs((surface.getEntry(i-1,j)+surface.getEntry(i+1,j)+surface.getEntry(i,j-1)+
+                                surface.getEntry(i,j+1))/4-surface.getEntry(i,j)));
+    BOOST_CHECK_LE(res,1e-9*scale);
+}
+
+/**** price cache ****/
+
+BOOST_AUTO_TEST_CASE(priceCacheReturnsExactValues){
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    Pricer pricer(Option("American","Put",100,1),market);
+    SimulationConfig config(1,300);
+    double uncached = pricer.calcPrice("Binomial Tree",config);
+    auto cache = make_shared<PriceCache>(2);
+    pricer.setPriceCache(cache);
+    BOOST_CHECK_EQUAL(pricer.calcPrice("Binomial Tree",config),uncached);
+    BOOST_CHECK_EQUAL(pricer.calcPrice("Binomial Tree",config),uncached);
+    BOOST_CHECK_EQUAL(cache->getHits(),1);
+    BOOST_CHECK_EQUAL(cache->getMisses(),1);
+    pricer.setVariable(VOLATILITY,0.3);
+    BOOST_CHECK_NE(pricer.calcPrice("Binomial Tree",config),uncached);
+    BOOST_CHECK_EQUAL(cache->getMisses(),2);
+}
+
+BOOST_AUTO_TEST_CASE(priceCacheMonteCarlo){
+    // a seeded lognormal run is cached with its standard error, jump-diffusion paths are never replayed
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    Pricer pricer(Option("European","Put",100,1),market);
+    SimulationConfig config(1,50);
+    config.seed = 7;
+    auto cache = make_shared<PriceCache>();
+    pricer.setPriceCache(cache);
+    double price = pricer.calcPrice("Monte Carlo",config,20000);
+    double err = pricer.tmp[0];
+    pricer.tmp.clear();
+    BOOST_CHECK_EQUAL(pricer.calcPrice("Monte Carlo",config,20000),price);
+    BOOST_REQUIRE(!pricer.tmp.empty());
+    BOOST_CHECK_EQUAL(pricer.tmp[0],err);
+    BOOST_CHECK_EQUAL(cache->getHits(),1);
+    market.setStock(Stock(100,0.02,0.05,0.2,{0.5,-0.1,0.2},"jump-diffusion"));
+    Pricer jumpPricer(Option("European","Put",100,1),market);
+    jumpPricer.setPriceCache(cache);
+    jumpPricer.calcPrice("Monte Carlo",config,20000);
+    jumpPricer.calcPrice("Monte Carlo",config,20000);
+    BOOST_CHECK_EQUAL(cache->getHits(),1);
+    BOOST_CHECK_EQUAL(cache->getSize(),1u);
+}
+
+BOOST_AUTO_TEST_CASE(priceCacheSimulationGreeks){
+    // simulation greeks run Monte Carlo whatever the pricing method, so they are cached only when seeded
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    Pricer pricer(Option("European","Call",100,1),market);
+    auto cache = make_shared<PriceCache>();
+    pricer.setPriceCache(cache);
+    SimulationConfig config(1,50);
+    pricer.calcGreek("Delta","Simulation","Closed Form",config,2000);
+    pricer.calcGreek("Delta","Simulation","Closed Form",config,2000);
+    BOOST_CHECK_EQUAL(cache->getHits(),0);
+    BOOST_CHECK_EQUAL(cache->getSize(),0u);
+    config.seed = 7;
+    double delta = pricer.calcGreek("Delta","Simulation","Closed Form",config,2000);
+    BOOST_CHECK_EQUAL(pricer.calcGreek("Delta","Simulation","Closed Form",config,2000),delta);
+    BOOST_CHECK_EQUAL(cache->getHits(),1);
+}
+
+BOOST_AUTO_TEST_CASE(priceCacheEvictsLeastRecentlyUsed){
+    PriceCache cache(2);
+    double v;
+    cache.insert("a",1);
+    cache.insert("b",2);
+    BOOST_CHECK(cache.lookup("a",v) && v==1); // b is now the least recent
+    cache.insert("c",3);
+    BOOST_CHECK(!cache.lookup("b",v));
+    BOOST_CHECK(cache.lookup("a",v) && v==1);
+    BOOST_CHECK(cache.lookup("c",v) && v==3);
+    BOOST_CHECK_EQUAL(cache.getEvictions(),1);
+    BOOST_CHECK_EQUAL(cache.getSize(),2u);
+}
+
+/**** multi-stock control variates ****/
+
+BOOST_AUTO_TEST_CASE(margrabeControlVariate){
+    // the terminal spread control cuts the standard error without collapsing onto the closed form
+    Stock s0(100,0.02,0.05,0.3), s1(95,0.01,0.05,0.2);
+    double cor[2][2] = {{1,0.3},{0.3,1}};
+    Market market(0.05,s0,{s0,s1},matrix(cor));
+    Pricer pricer(Option("Margrabe","Call",0,1),market);
+    SimulationConfig config(1,50);
+    config.seed = 3;
+    double exact = pricer.BlackScholesClosedForm();
+    pricer.MultiStockMonteCarloPricer(config,100000,"simple");
+    double simpleErr = pricer.tmp[0];
+    double price = pricer.MultiStockMonteCarloPricer(config,100000,"control variates");
+    double err = pricer.tmp[0];
+    BOOST_CHECK_LT(err,simpleErr);
+    BOOST_CHECK_GT(err,1e-3);
+    BOOST_CHECK_SMALL(price-exact,4*err);
+}
+
+/**** risk ladder ****/
+
+BOOST_AUTO_TEST_CASE(riskLadderMultiStockMonteCarlo){
+    // per-stock and correlation bumps of a Margrabe option go through the multi-stock Monte Carlo on common
+    // random numbers and land next to the closed form
+    Stock s0(100,0.02,0.05,0.3), s1(95,0.01,0.05,0.2);
+    double cor[2][2] = {{1,0.3},{0.3,1}};
+    Market market(0.05,s0,{s0,s1},matrix(cor));
+    Pricer pricer(Option("Margrabe","Call",0,1),market);
+    SimulationConfig config(1,50);
+    config.seed = 5;
+    vector<RiskBump> ladder = pricer.getRiskLadder();
+    vector<double> exact = pricer.calcSensitivities(ladder,"Closed Form");
+    vector<double> simulated = pricer.calcSensitivities(ladder,"Monte Carlo",config,20000);
+    for(size_t k=0; k<ladder.size(); k++){
+        if(ladder[k].var==CURRENT_PRICE && ladder[k].derivOrder==1) BOOST_CHECK_SMALL(simulated[k]-exact[k],5e-3);
+        if(ladder[k].var==CORRELATION) BOOST_CHECK_CLOSE(simulated[k],exact[k],2.);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(riskLadderReseedsRand){
+    // single-stock jump-diffusion reseeds the global generator per scenario, and once done from the draw
+    // taken before the first one, so that rand() carries on as if seeded by that draw
+    Market market(0.05,Stock(100,0.02,0.05,0.2,{0.5,-0.1,0.2},"jump-diffusion"));
+    Pricer pricer(Option("European","Put",100,1),market);
+    SimulationConfig config(1,20);
+    config.seed = 5;
+    srand(1);
+    unsigned draw = rand();
+    srand(draw);
+    int expected = rand();
+    srand(1);
+    pricer.calcSensitivities({RiskBump(CURRENT_PRICE,1)},"Monte Carlo",config,1000);
+    BOOST_CHECK_EQUAL(rand(),expected);
+}
+
+/**** closed-form greeks ****/
+
+BOOST_AUTO_TEST_CASE(closedFormGreeksMatchFiniteDifferences){
+    // every greek of the European and the Digital, scalar and batch, against central differences of the
+    // price (first orders) or of the closed-form delta and vega (second orders); theta and charm are in
+    // calendar time, minus the derivative in T
+    struct Case{OptionType type; PutCall putCall; double S0, K, T, r, q, sig;};
+    vector<Case> cases;
+    for(OptionType type:{EUROPEAN,DIGITAL})
+        for(PutCall putCall:{CALL,PUT})
+            for(double K:{80.,100.,120.})
+                for(double T:{0.25,2.})
+                    cases.push_back({type,putCall,100,K,T,0.04,0.01,0.25});
+    BatchPricer europeans(EUROPEAN,(int)cases.size()), digitals(DIGITAL,(int)cases.size());
+    for(const Case& c:cases) (c.type==EUROPEAN?europeans:digitals).addOption(c.S0,c.K,c.T,c.r,c.q,c.sig,c.putCall==CALL);
+    BatchGreeks batchGreeks[2] = {europeans.calcGreeks(),digitals.calcGreeks()};
+    int batchIndex[2] = {0,0};
+    for(const Case& c:cases){
+        auto greeks = [&](double S0, double T, double r, double sig){
+            return Pricer::BlackScholesGreeks(c.type,c.putCall,S0,c.K,T,r,c.q,sig);
+        };
+        double hS = 1e-4*c.S0, hT = 1e-5, hr = 1e-5, hs = 1e-5;
+        Greeks g = greeks(c.S0,c.T,c.r,c.sig), fd = NULL_GREEKS;
+        Greeks Su = greeks(c.S0+hS,c.T,c.r,c.sig), Sd = greeks(c.S0-hS,c.T,c.r,c.sig);
+        Greeks su = greeks(c.S0,c.T,c.r,c.sig+hs), sd = greeks(c.S0,c.T,c.r,c.sig-hs);
+        Greeks Tu = greeks(c.S0,c.T+hT,c.r,c.sig), Td = greeks(c.S0,c.T-hT,c.r,c.sig);
+        Greeks ru = greeks(c.S0,c.T,c.r+hr,c.sig), rd = greeks(c.S0,c.T,c.r-hr,c.sig);
+        fd.delta = (Su.price-Sd.price)/(2*hS);
+        fd.gamma = (Su.price-2*g.price+Sd.price)/(hS*hS);
+        fd.vega  = (su.price-sd.price)/(2*hs);
+        fd.rho   = (ru.price-rd.price)/(2*hr);
+        fd.theta = -(Tu.price-Td.price)/(2*hT);
+        fd.vanna = (su.delta-sd.delta)/(2*hs);
+        fd.volga = (su.vega-sd.vega)/(2*hs);
+        fd.charm = -(Tu.delta-Td.delta)/(2*hT);
+        int t = c.type==EUROPEAN?0:1, k = batchIndex[t]++;
+        const BatchGreeks& b = batchGreeks[t];
+        vector<double> exact = {fd.delta,fd.gamma,fd.vega,fd.rho,fd.theta,fd.vanna,fd.volga,fd.charm};
+        vector<double> scalar = {g.delta,g.gamma,g.vega,g.rho,g.theta,g.vanna,g.volga,g.charm};
+        vector<double> batch = {b.delta[k],b.gamma[k],b.vega[k],b.rho[k],b.theta[k],b.vanna[k],b.volga[k],b.charm[k]};
+        BOOST_CHECK_SMALL(b.price[k]-g.price,1e-12*c.S0);
+        for(size_t j=0; j<exact.size(); j++){
+            double tol = 1e-5*(fabs(exact[j])+1e-3*fabs(g.vega)/c.sig);
+            BOOST_CHECK_SMALL(scalar[j]-exact[j],tol);
+            BOOST_CHECK_SMALL(batch[j]-exact[j],tol);
+        }
+    }
+}
+
+/**** simulation greeks ****/
+
+BOOST_AUTO_TEST_CASE(simulationGreeksMatchClosedForm){
+    // delta, gamma, vega and rho estimated on the pricing paths lie within a few standard errors of the
+    // closed form, pathwise for the European and by likelihood ratio for the Digital
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    SimulationConfig config(1,50);
+    config.seed = 11;
+    for(string type:{"European","Digital"})
+        for(string putCall:{"Call","Put"}){
+            Pricer pricer(Option(type,putCall,105,1),market);
+            Greeks exact = pricer.ClosedFormGreeks();
+            Greeks greeks = pricer.calcGreeks("Simulation","Monte Carlo",config,200000);
+            Greeks errs = pricer.getSimGreekErrs();
+            BOOST_REQUIRE(errs.delta>0 && errs.gamma>0 && errs.vega>0 && errs.rho>0);
+            BOOST_CHECK_SMALL(greeks.price-exact.price,4*errs.price);
+            BOOST_CHECK_SMALL(greeks.delta-exact.delta,4*errs.delta);
+            BOOST_CHECK_SMALL(greeks.gamma-exact.gamma,4*errs.gamma);
+            BOOST_CHECK_SMALL(greeks.vega-exact.vega,4*errs.vega);
+            BOOST_CHECK_SMALL(greeks.rho-exact.rho,4*errs.rho);
+        }
+}
+
+/**** algorithmic differentiation ****/
+
+BOOST_AUTO_TEST_CASE(priceGradientMatchesClosedFormGreeks){
+    // forward and adjoint sweeps through the closed form give its greeks, in the order of AD_VARIABLES
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    for(string type:{"European","Digital"})
+        for(string putCall:{"Call","Put"})
+            for(double K:{90.,110.}){
+                Pricer pricer(Option(type,putCall,K,1.5),market);
+                Greeks exact = pricer.ClosedFormGreeks();
+                for(string mode:{"Forward","Adjoint"}){
+                    vector<double> gradient = pricer.calcPriceGradient("Closed Form",mode);
+                    BOOST_REQUIRE_EQUAL(gradient.size(),1+AD_VARIABLES.size());
+                    BOOST_CHECK_SMALL(gradient[0]-exact.price,1e-10);
+                    BOOST_CHECK_SMALL(gradient[1]-exact.delta,1e-10);
+                    BOOST_CHECK_SMALL(-gradient[3]-exact.theta,1e-8);
+                    BOOST_CHECK_SMALL(gradient[4]-exact.rho,1e-8);
+                    BOOST_CHECK_SMALL(gradient[6]-exact.vega,1e-8);
+                }
+            }
+}
+
+/**** PDE grid ****/
+
+BOOST_AUTO_TEST_CASE(priceGridGreeksMatchClosedForm){
+    // one solve answers price, delta, gamma and theta at several spots and at a later time, each against
+    // the closed form of the option with the remaining maturity; the grid converges at first order, so the
+    // tolerances are those of 400 nodes
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    Pricer pricer(Option("European","Put",100,1),market);
+    PriceGrid grid = pricer.BlackScholesPDEGrid(SimulationConfig(1,400),400);
+    BOOST_REQUIRE(!grid.isEmpty());
+    for(double t:{0.,0.5})
+        for(double S:{85.,100.,115.}){
+            Greeks exact = Pricer::BlackScholesGreeks(EUROPEAN,PUT,S,100,1-t,0.05,0.02,0.2);
+            Greeks greeks = grid.calcGreeks(S,t);
+            BOOST_CHECK_SMALL(greeks.price-exact.price,1e-2);
+            BOOST_CHECK_SMALL(greeks.delta-exact.delta,1e-3);
+            BOOST_CHECK_CLOSE(greeks.gamma,exact.gamma,3.);
+            BOOST_CHECK_SMALL(greeks.theta-exact.theta,2e-2);
+        }
+}
+
+/**** logger ****/
+
+BOOST_AUTO_TEST_CASE(loggerFiltersAndEscapes){
+    // records below the level are dropped, JSON records escape quotes, backslashes and control characters
+    ostringstream out;
+    Logger logger(LOG_INFO);
+    logger.setOutput(&out);
+    logger.setJson(true);
+    logger.log(LOG_DEBUG,"hidden {}",1);
+    logger.log(LOG_WARN,"a\t{} {}",string("q\"b\\n\n\x01"),2.5);
+    logger.flush();
+    string line = out.str();
+    BOOST_CHECK_EQUAL(logger.getNumWritten(),1);
+    BOOST_CHECK(line.find("hidden")==string::npos);
+    BOOST_CHECK(line.find("\"level\":\"warn\"")!=string::npos);
+    BOOST_CHECK(line.find("\"msg\":\"a\\u0009q\\\"b\\\\n\\u000a\\u0001 2.500000\"")!=string::npos);
+    BOOST_CHECK(line.find("\"args\":[\"q\\\"b\\\\n\\u000a\\u0001\",2.5]")!=string::npos);
+    BOOST_CHECK_EQUAL(count(line.begin(),line.end(),'\n'),1);
+}
+
+/**** metrics ****/
+
+BOOST_AUTO_TEST_CASE(metricsCountLatticeNodes){
+    // the nodes counter of BinomialTreePricer holds the nodes the lattices visit: the terminal layer of an
+    // O(n) European sum, the band of an American induction, both lattices of a Richardson method
+    Metrics& metrics = Metrics::global();
+    bool enabled = metrics.isEnabled();
+    metrics.setEnabled(true);
+    Market market(0.05,Stock(100,0.02,0.05,0.2));
+    auto nodes = [&](string type, string method){
+        metrics.clear();
+        Pricer(Option(type,"Put",100,1),market).BinomialTreePricer(SimulationConfig(1,1000),method);
+        BOOST_CHECK_EQUAL(metrics.getSpanStats("BinomialTreePricer").count,1);
+        return metrics.getCounterStats("nodes").items;
+    };
+    BOOST_CHECK_EQUAL(nodes("European","CRR"),1001);
+    BOOST_CHECK_EQUAL(nodes("European","LRR"),1002+502); // 1001 and 501 steps
+    double american = nodes("American","CRR");
+    BOOST_CHECK_GT(american,1001);
+    BOOST_CHECK_LT(american,1001.*1002/2);
+    metrics.clear();
+    metrics.setEnabled(enabled);
+}
+
+/**** bootstrap ****/
+
+BOOST_AUTO_TEST_CASE(bootstrapNeedsTwoPrices){
+    // fewer than two prices leave no return to resample and give no paths
+    Stock stock(100,0.02,0.05,0.2);
+    SimulationConfig config(1,10);
+    for(string method:{"iid","moving-block","stationary"}){
+        BOOST_CHECK(stock.bootstrapPricePaths(matrix(),config,5,method).isEmpty());
+        BOOST_CHECK(stock.bootstrapPricePaths(matrix(vector<double>{100}),config,5,method).isEmpty());
+        BOOST_CHECK(stock.bootstrapPrice(matrix(vector<double>{100}),config,5,method).isEmpty());
+        PathBuffer paths = stock.bootstrapPricePaths(matrix(vector<double>{100,101,99,102}),config,5,method);
+        BOOST_CHECK_EQUAL(paths.getPaths(),5);
+    }
+}